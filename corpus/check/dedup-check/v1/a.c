@@ -0,0 +1,10 @@
+#define SCALE 2
+#define PAIR_LAYOUT
+#include "shared.h"
+
+int a_entry(int x) { return clamp(scale(x), 0, 100); }
+
+int a_value(struct pair *p) { return pair_value(p); }
+
+/* Gone in v2 (so is its file) */
+int a_gone(int x) { return x + 1; }
@@ -0,0 +1,7 @@
+#define SCALE 3
+#define PAIR_LAYOUT __attribute__((packed, aligned(4)))
+#include "shared.h"
+
+int b_entry(int x) { return clamp(scale(x), -100, 100); }
+
+int b_value(struct pair *p) { return pair_value(p); }
@@ -0,0 +1,23 @@
+/* Pulled into both TUs: clamp is the same body in each (one is a
+ * duplicate), scale isn't (SCALE differs), so the two share a name, and
+ * neither is pair_value: struct pair has the same fields and size in each
+ * but not the same layout (PAIR_LAYOUT differs) */
+
+static inline int clamp(int x, int lo, int hi) {
+  if (x < lo) {
+    return lo;
+  }
+  if (x > hi) {
+    return hi;
+  }
+  return x;
+}
+
+static inline int scale(int x) { return x * SCALE; }
+
+struct pair {
+  char tag;
+  int value;
+} PAIR_LAYOUT;
+
+static inline int pair_value(struct pair *p) { return p->value; }
@@ -3,6 +3,20 @@ set -ex;
 
 chown -R `stat -c "%u:%g" /common/facts` /common/facts
 
+# Which procedure bodies have been transformed is per ingest (see
+# plugin/Utility/content-index.hpp). If these facts already hold an
+# ingest (of an earlier commit, say), its markers tell the plugin which
+# procedures are unchanged and can keep their files
+cd /common/facts
+rm -rf .content.prev manifest.prev.tsv
+if [ -d .content ]; then
+  mv .content .content.prev
+fi
+if [ -f manifest.tsv ]; then
+  mv manifest.tsv manifest.prev.tsv
+fi
+cd - > /dev/null
+
 # First, grab them from the volume
 cp -r /mnt/gcc7.3.0/* /usr/local/
 
@@ -34,6 +48,25 @@ echo "Activating analysis"
 echo "Analyzing..."
 /target/do-make
 
+cd /common/facts
+if [ -f manifest.prev.tsv ]; then
+  # Whatever the last ingest wrote that this one didn't is gone (in tu
+  # mode a procedure is <module>#<name>, and the module goes once none of
+  # its procedures are left)
+  touch manifest.tsv
+  awk -F'\t' '{ sub(/#.*/, "", $5) }
+               NR == FNR { if ($2 != "duplicate") { keep[$5] = 1 } next }
+               $2 != "duplicate" && !($5 in keep) { print $5 }' \
+    manifest.tsv manifest.prev.tsv | sort -u | while IFS= read -r stale; do
+      rm -f "$stale"
+    done
+  echo "Reused $(awk -F'\t' '$2 == "reused"' manifest.tsv | wc -l)," \
+       "regenerated $(awk -F'\t' '$2 == "emitted"' manifest.tsv | wc -l)" \
+       "procedures"
+fi
+rm -rf .content.prev manifest.prev.tsv
+cd - > /dev/null
+
 sync
 
 # Check status
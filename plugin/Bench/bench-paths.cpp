@@ -0,0 +1,234 @@
+/* Bench/bench-paths.cpp
+ *
+ * Description:
+ *  - Replays serialized CFGs (see Paths/cfg-text.hpp) through the path
+ *    enumerator and reports where the time and memory went, so the
+ *    enumerator can be profiled without a corpus ingest
+ *
+ *    usage: bench-paths [-k unroll] [-V max-vertices] [-E max-edges]
+ *                       [-P max-paths] [-r repeats] [-o out.ml] [-v]
+ *                       [-c] [-C cache-dir] [-a] [file.cfg ...]
+ *
+ *    -c runs everything through a PathCache (as the plugin does), -C
+ *    also shares it through cache-dir. -a gives each procedure the
+ *    scratch arena the plugin gives it (and reports its traffic)
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "../Paths/cfg-text.hpp"
+#include "../Paths/path-cache.hpp"
+#include "../Paths/path-enumeration.hpp"
+
+using namespace c2ocaml::frontend;
+
+namespace {
+
+void Usage(const char *self) {
+  std::cerr << "usage: " << self
+            << " [-k unroll] [-V max-vertices] [-E max-edges] [-P max-paths]"
+               " [-r repeats] [-o out.ml] [-v] [-c] [-C cache-dir] [-a]"
+               " [file.cfg ...]"
+            << std::endl;
+}
+
+bool ReadAll(std::istream &in, const std::string &from,
+             std::vector<CfgInput> &cfgs) {
+  CfgInput cfg;
+  std::string err;
+
+  while (ReadCfg(in, cfg, err)) {
+    cfgs.push_back(cfg);
+  }
+
+  if (!err.empty()) {
+    std::cerr << from << ": " << err << std::endl;
+    return false;
+  }
+  return true;
+}
+
+double Millis(double secs) { return secs * 1000.0; }
+}
+
+int main(int argc, char **argv) {
+  EnumerationBudget budget;
+  uint32_t repeats = 1;
+  bool verbose = false;
+  bool cached = false;
+  bool arenas = false;
+  std::string outPath, cacheDir;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "k:V:E:P:r:o:vcC:ah")) != -1) {
+    switch (opt) {
+    case 'k':
+      budget.maxUnroll = (uint16_t)std::max(1, atoi(optarg));
+      break;
+    case 'V':
+      budget.maxVertices = strtoull(optarg, nullptr, 10);
+      break;
+    case 'E':
+      budget.maxEdges = strtoull(optarg, nullptr, 10);
+      break;
+    case 'P':
+      budget.maxPaths = strtoull(optarg, nullptr, 10);
+      break;
+    case 'r':
+      repeats = (uint32_t)std::max(1, atoi(optarg));
+      break;
+    case 'o':
+      outPath = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'c':
+      cached = true;
+      break;
+    case 'C':
+      cached = true;
+      cacheDir = optarg;
+      break;
+    case 'a':
+      arenas = true;
+      break;
+    default:
+      Usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  // Load everything up front so parsing doesn't count against us
+  std::vector<CfgInput> cfgs;
+  if (optind == argc) {
+    if (!ReadAll(std::cin, "<stdin>", cfgs)) {
+      return 1;
+    }
+  }
+  for (auto i = optind; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    if (!in) {
+      std::cerr << argv[i] << ": cannot open" << std::endl;
+      return 1;
+    }
+    if (!ReadAll(in, argv[i], cfgs)) {
+      return 1;
+    }
+  }
+
+  std::ofstream out;
+  if (!outPath.empty()) {
+    out.open(outPath, std::ofstream::out | std::ofstream::trunc);
+  }
+
+  PathCache cache(cacheDir);
+
+  util::arena scratch;
+  uint64_t arenaAllocations = 0, arenaBytes = 0, arenaMallocs = 0;
+
+  EnumerationStats total;
+  uint64_t summarized = 0, outBytes = 0;
+  std::vector<std::pair<double, std::string>> slowest;
+
+  for (uint32_t rep = 0; rep < repeats; ++rep) {
+    for (auto &cfg : cfgs) {
+      EnumerationResult res;
+      if (arenas) {
+        util::arena::scope use(scratch);
+        res = cached ? cache.Enumerate(cfg, budget)
+                     : PathEnumerator::Enumerate(cfg, budget);
+      } else {
+        res = cached ? cache.Enumerate(cfg, budget)
+                     : PathEnumerator::Enumerate(cfg, budget);
+      }
+
+      arenaAllocations += scratch.num_allocations();
+      arenaBytes += scratch.num_bytes();
+      arenaMallocs += scratch.num_mallocs();
+      scratch.reset();
+
+      auto &s = res.stats;
+      auto secs = s.classifySecs + s.unrollSecs + s.countSecs + s.emitSecs;
+
+      total.classifySecs += s.classifySecs;
+      total.unrollSecs += s.unrollSecs;
+      total.countSecs += s.countSecs;
+      total.emitSecs += s.emitSecs;
+      total.attempts += s.attempts;
+      total.vertices += s.vertices;
+      total.edges += s.edges;
+      total.peakBytes = std::max(total.peakBytes, s.peakBytes);
+      summarized += res.summarized ? 1 : 0;
+      outBytes += res.cfg.size();
+
+      // Only keep the output and per-function numbers of the first pass
+      if (rep != 0) {
+        continue;
+      }
+
+      slowest.push_back(std::make_pair(secs, cfg.name));
+
+      if (verbose) {
+        std::cerr << cfg.name << " K=" << res.unroll << " verts=" << s.vertices
+                  << " edges=" << s.edges << " bytes=" << s.peakBytes
+                  << " ms=" << Millis(secs)
+                  << (res.reason.empty() ? "" : " (" + res.reason + ")")
+                  << std::endl;
+      }
+
+      if (out.is_open()) {
+        out << "== " << cfg.name << "\n" << res.cfg << "\n";
+      }
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::sort(slowest.rbegin(), slowest.rend());
+  slowest.resize(std::min<size_t>(slowest.size(), 5));
+
+  auto totalSecs =
+      total.classifySecs + total.unrollSecs + total.countSecs + total.emitSecs;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "procedures   " << cfgs.size() << " x " << repeats
+            << " (summarized " << summarized << ", attempts "
+            << total.attempts << ")" << std::endl;
+  std::cout << "classify ms  " << Millis(total.classifySecs) << std::endl;
+  std::cout << "unroll ms    " << Millis(total.unrollSecs) << std::endl;
+  std::cout << "count ms     " << Millis(total.countSecs) << std::endl;
+  std::cout << "emit ms      " << Millis(total.emitSecs) << std::endl;
+  std::cout << "total ms     " << Millis(totalSecs) << std::endl;
+  std::cout << "vertices     " << total.vertices << std::endl;
+  std::cout << "edges        " << total.edges << std::endl;
+  std::cout << "output bytes " << outBytes << std::endl;
+  std::cout << "peak graph   " << total.peakBytes / 1024 << " KiB" << std::endl;
+  std::cout << "max rss      " << usage.ru_maxrss << " KiB" << std::endl;
+  if (cached) {
+    std::cout << "cache        " << cache.Hits() << " hits, "
+              << cache.DiskHits() << " disk hits, " << cache.Misses()
+              << " misses" << std::endl;
+  }
+  if (arenas) {
+    std::cout << "arena        " << arenaAllocations << " allocations, "
+              << arenaBytes / 1024 << " KiB, " << arenaMallocs << " mallocs"
+              << std::endl;
+  }
+  for (auto &slow : slowest) {
+    std::cout << "slowest      " << slow.second << " " << Millis(slow.first)
+              << " ms" << std::endl;
+  }
+
+  return 0;
+}
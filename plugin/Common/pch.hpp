@@ -6,17 +6,24 @@
 #include <cctype>
 #include <chrono>
 #include <climits>
+#include <condition_variable>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <locale>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <stack>
 #include <string>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <sys/stat.h>
@@ -49,6 +56,7 @@ namespace fs = std::experimental::filesystem::v1;
 #include "internal-fn.h"
 #include "is-a.h"
 #include "predict.h"
+#include "real.h"
 #include "stor-layout.h"
 #include "trans-mem.h"
 #include "tree-dump.h"
@@ -75,4 +83,8 @@ namespace fs = std::experimental::filesystem::v1;
 #include "cgraph.h"
 #include "ssa.h"
 
+// Loop bounds (niter analysis)
+#include "tree-scalar-evolution.h"
+#include "tree-ssa-loop-niter.h"
+
 #endif // c2ocaml_PCH_HPP_
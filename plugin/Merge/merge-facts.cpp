@@ -0,0 +1,637 @@
+/* Merge/merge-facts.cpp
+ *
+ * Description:
+ *  - The native merge-sources: turns a facts tree (one <name>.ml per
+ *    procedure, grouped in a directory per source file) into one module
+ *    per source file, preamble first. Directories are walked and merged
+ *    by a pool of threads, and files are spliced into their module with
+ *    copy_file_range (falling back to large sequential read/writes), so
+ *    nothing is read into user space that doesn't have to be. Output is
+ *    byte-for-byte what the merge-sources script produces (both put files
+ *    in byte order; the script runs with LC_ALL=C for that)
+ *
+ *    usage: merge-facts [-j threads] [-p preamble.txt] [-s shard-bytes]
+ *                       [-n shard-procedures] [-v] facts-dir
+ *
+ *    Writes <facts-dir>-merged and reports throughput for each phase.
+ *    With -s/-n (positive numbers) a directory over either budget is
+ *    split into as many <name>.part<i>.ml shards as it takes to fit (a
+ *    procedure bigger than -s gets a shard to itself), balanced by size
+ *    (the best guess we have at what ocamlopt will make of them), so one
+ *    huge directory doesn't hold up the downstream build
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// What merge-sources strips off the front of a merged file's name
+const char *REMOVE = "artifacts-";
+
+// Where -fplugin-arg-c2ocaml-type-catalog is pointed (see
+// Utility/type-catalog.hpp)
+const char *CATALOG_DIR = ".types";
+
+// The plugin's record of which bodies it has transformed, and where each
+// procedure went (see Utility/content-index.hpp)
+const char *CONTENT_DIR = ".content";
+const char *MANIFEST = "manifest.tsv";
+
+void Usage(const char *self) {
+  std::cerr << "usage: " << self
+            << " [-j threads] [-p preamble.txt] [-s shard-bytes]"
+               " [-n shard-procedures] [-v] facts-dir"
+            << std::endl;
+}
+
+/*
+ * WorkPool - runs tasks (which may add more tasks) on a fixed set of
+ *            threads until there are none left
+ */
+class WorkPool {
+  std::mutex lock;
+  std::condition_variable wake;
+  std::deque<std::function<void()>> tasks;
+  size_t busy = 0;
+  bool done = false;
+  std::vector<std::thread> threads;
+
+  void Work() {
+    std::unique_lock<std::mutex> hold(lock);
+    for (;;) {
+      wake.wait(hold, [this] { return done || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+
+      auto task = std::move(tasks.front());
+      tasks.pop_front();
+      busy += 1;
+
+      hold.unlock();
+      task();
+      hold.lock();
+
+      busy -= 1;
+      if (busy == 0 && tasks.empty()) {
+        done = true;
+        wake.notify_all();
+      }
+    }
+  }
+
+public:
+  explicit WorkPool(size_t count) : threads(std::max<size_t>(1, count)) {}
+
+  void Add(std::function<void()> task) {
+    std::lock_guard<std::mutex> hold(lock);
+    tasks.push_back(std::move(task));
+    wake.notify_one();
+  }
+
+  // Runs everything added (before or during) to completion
+  void Run() {
+    {
+      std::lock_guard<std::mutex> hold(lock);
+      done = tasks.empty();
+    }
+    for (auto &thread : threads) {
+      thread = std::thread(&WorkPool::Work, this);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+};
+
+struct Input {
+  std::string name;
+  uint64_t size;
+};
+
+// One output file: the preamble (maybe) followed by its inputs, in order
+struct Job {
+  std::string dir;
+  std::vector<Input> inputs;
+  std::string output;
+  bool preamble;
+};
+
+struct Phase {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<uint64_t> files{0};
+  std::atomic<uint64_t> bytes{0};
+
+  void Report(const char *name) const {
+    auto secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    auto rate = [secs](double n) { return secs > 0 ? n / secs : 0.0; };
+
+    std::cout << std::fixed << std::setprecision(2) << std::left
+              << std::setw(9) << name << std::right << files << " files, "
+              << bytes / 1048576.0 << " MB in " << secs * 1000.0 << " ms ("
+              << rate(files) << " files/s, " << rate(bytes / 1048576.0)
+              << " MB/s)" << std::endl;
+  }
+};
+
+uint64_t Bytes(const Job &job) {
+  uint64_t bytes = 0;
+  for (auto &input : job.inputs) {
+    bytes += input.size;
+  }
+  return bytes;
+}
+
+// Splits a job over budget (either one, 0 is unlimited) into shards, each
+// input going to the lightest shard so far, biggest inputs first (LPT);
+// within a shard the inputs keep their order. LPT can overshoot the byte
+// budget with as many shards as it takes on paper, so we add shards until
+// every one fits (or holds a single procedure that is over budget on its
+// own)
+std::vector<Job> Shard(Job job, uint64_t maxBytes, uint64_t maxInputs) {
+  uint64_t count = 1;
+  if (maxBytes != 0) {
+    count = std::max(count, (Bytes(job) + maxBytes - 1) / maxBytes);
+  }
+  if (maxInputs != 0) {
+    count = std::max<uint64_t>(
+        count, (job.inputs.size() + maxInputs - 1) / maxInputs);
+  }
+  count = std::min<uint64_t>(count, job.inputs.size());
+
+  if (count <= 1) {
+    return {std::move(job)};
+  }
+
+  std::stable_sort(job.inputs.begin(), job.inputs.end(),
+                   [](const Input &a, const Input &b) {
+                     return a.size > b.size;
+                   });
+
+  auto base = job.output.substr(0, job.output.size() - strlen(".ml"));
+  std::vector<Job> shards;
+  for (;; ++count) {
+    shards.assign(count, Job());
+    std::vector<uint64_t> loads(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+      shards[i].dir = job.dir;
+      shards[i].output = base + ".part" + std::to_string(i) + ".ml";
+      shards[i].preamble = job.preamble;
+    }
+
+    for (auto &input : job.inputs) {
+      // A byte budget can't split a single procedure, but a procedure
+      // budget has to hold
+      size_t lightest = 0;
+      for (size_t i = 0; i < count; ++i) {
+        auto full = maxInputs != 0 && shards[i].inputs.size() >= maxInputs;
+        auto fullest = maxInputs != 0 &&
+                       shards[lightest].inputs.size() >= maxInputs;
+        if (!full && (fullest || loads[i] < loads[lightest])) {
+          lightest = i;
+        }
+      }
+      shards[lightest].inputs.push_back(input);
+      loads[lightest] += input.size;
+    }
+
+    auto fits = true;
+    for (size_t i = 0; i < count; ++i) {
+      if (maxBytes != 0 && loads[i] > maxBytes &&
+          shards[i].inputs.size() > 1) {
+        fits = false;
+      }
+    }
+    if (fits || count >= job.inputs.size()) {
+      break;
+    }
+  }
+
+  for (auto &shard : shards) {
+    std::sort(shard.inputs.begin(), shard.inputs.end(),
+              [](const Input &a, const Input &b) { return a.name < b.name; });
+  }
+  return shards;
+}
+
+// A budget for -s/-n: a positive number (leave the flag out for no limit)
+bool ParseBudget(const char *arg, uint64_t &res) {
+  char *end = nullptr;
+  errno = 0;
+  auto value = strtoull(arg, &end, 10);
+  if (!isdigit(static_cast<unsigned char>(arg[0])) || *end != '\0' ||
+      errno != 0 || value == 0) {
+    return false;
+  }
+  res = value;
+  return true;
+}
+
+bool EndsWith(const std::string &s, const char *suffix) {
+  auto n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// The merged file's name for a directory, as merge-sources spells it
+std::string MergedName(const std::string &dir) {
+  std::string name;
+  for (auto c : dir) {
+    name += isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' ||
+                    c == '-'
+                ? c
+                : '-';
+  }
+  name += ".ml";
+
+  auto at = name.find(REMOVE);
+  return at == std::string::npos ? name : name.substr(at + strlen(REMOVE));
+}
+
+bool ReadFile(const std::string &path, std::string &contents) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream buffer;
+  buffer << in.rdbuf();
+  contents = buffer.str();
+  return static_cast<bool>(in);
+}
+
+bool WriteAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    auto n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Appends size bytes of in to out (both at their current offsets)
+bool Splice(int in, int out, uint64_t size) {
+#ifdef SYS_copy_file_range
+  // Done in the kernel (or the filesystem) when it can be
+  while (size > 0) {
+    auto n = syscall(SYS_copy_file_range, in, nullptr, out, nullptr,
+                     static_cast<size_t>(size), 0u);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    size -= static_cast<uint64_t>(n);
+  }
+  if (size == 0) {
+    return true;
+  }
+#endif
+
+  // Not supported here (old kernel, across filesystems, ...) or the file
+  // changed size under us: copy the rest ourselves
+  static thread_local std::vector<char> buffer(1 << 20);
+  for (;;) {
+    auto n = read(in, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    if (!WriteAll(out, buffer.data(), static_cast<size_t>(n))) {
+      return false;
+    }
+  }
+}
+
+bool Merge(const Job &job, const std::string &preamble, Phase &phase) {
+  auto out = open(job.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    return false;
+  }
+
+  auto ok = !job.preamble || WriteAll(out, preamble.data(), preamble.size());
+  uint64_t bytes = job.preamble ? preamble.size() : 0;
+
+  for (auto &input : job.inputs) {
+    if (!ok) {
+      break;
+    }
+    auto in = open((job.dir + "/" + input.name).c_str(), O_RDONLY);
+    ok = in >= 0 && Splice(in, out, input.size);
+    if (in >= 0) {
+      close(in);
+    }
+    bytes += input.size;
+  }
+
+  ok = close(out) == 0 && ok;
+
+  phase.files += job.inputs.size();
+  phase.bytes += bytes;
+  return ok;
+}
+
+/*
+ * Scanner - finds every directory with .ml files in it (in parallel; a
+ *           big ingest has tens of thousands of them)
+ */
+class Scanner {
+  WorkPool &pool;
+  Phase &phase;
+  std::mutex lock;
+
+public:
+  std::vector<Job> jobs;
+  std::vector<Input> topLevel;
+  std::atomic<bool> failed{false};
+
+  Scanner(WorkPool &pool, Phase &phase) : pool(pool), phase(phase) {}
+
+  void Scan(const std::string &dir, bool isRoot) {
+    auto handle = opendir(dir.c_str());
+    if (handle == nullptr) {
+      std::cerr << dir << ": " << strerror(errno) << std::endl;
+      failed = true;
+      return;
+    }
+
+    Job job;
+    job.dir = dir;
+    job.preamble = true;
+
+    while (auto entry = readdir(handle)) {
+      std::string name = entry->d_name;
+      if (name == "." || name == "..") {
+        continue;
+      }
+
+      auto type = entry->d_type;
+      uint64_t size = 0;
+      if (type == DT_UNKNOWN || type == DT_REG) {
+        struct stat st;
+        if (fstatat(dirfd(handle), name.c_str(), &st, 0) != 0) {
+          continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+          type = DT_DIR;
+        } else if (S_ISREG(st.st_mode)) {
+          type = DT_REG;
+        }
+        size = static_cast<uint64_t>(st.st_size);
+      }
+
+      if (type == DT_DIR) {
+        // The catalog has its own phase, the markers aren't output
+        if (!(isRoot && (name == CATALOG_DIR || name == CONTENT_DIR))) {
+          auto sub = dir + "/" + name;
+          pool.Add([this, sub]() { Scan(sub, false); });
+        }
+      } else if (type == DT_REG && name[0] != '.' && EndsWith(name, ".ml")) {
+        job.inputs.push_back(Input{name, size});
+      }
+    }
+    closedir(handle);
+
+    // Same order as the shell's glob
+    std::sort(job.inputs.begin(), job.inputs.end(),
+              [](const Input &a, const Input &b) { return a.name < b.name; });
+
+    phase.files += job.inputs.size();
+    for (auto &input : job.inputs) {
+      phase.bytes += input.size;
+    }
+
+    std::lock_guard<std::mutex> hold(lock);
+    if (isRoot) {
+      // TU modules (-fplugin-arg-c2ocaml-output=tu) are already merged
+      topLevel = std::move(job.inputs);
+    } else if (!job.inputs.empty()) {
+      jobs.push_back(std::move(job));
+    }
+  }
+};
+
+// Builds TypeCatalog.ml out of the catalog's depth directories (in order,
+// so every type is defined before it is used); returns the opens every
+// merged module needs for it
+std::string MergeCatalog(const std::string &root, const std::string &merged,
+                         const std::string &preamble, bool &ok, Phase &phase) {
+  auto dir = root + "/" + CATALOG_DIR;
+  auto handle = opendir(dir.c_str());
+  if (handle == nullptr) {
+    return "";
+  }
+
+  std::vector<std::string> depths;
+  while (auto entry = readdir(handle)) {
+    if (entry->d_name[0] != '.') {
+      depths.push_back(entry->d_name);
+    }
+  }
+  closedir(handle);
+  std::sort(depths.begin(), depths.end());
+
+  Job job;
+  job.dir = dir;
+  job.output = merged + "/TypeCatalog.ml";
+  job.preamble = true;
+
+  for (auto &depth : depths) {
+    auto sub = dir + "/" + depth;
+    auto subHandle = opendir(sub.c_str());
+    if (subHandle == nullptr) {
+      continue;
+    }
+
+    std::vector<Input> entries;
+    while (auto entry = readdir(subHandle)) {
+      std::string name = entry->d_name;
+      struct stat st;
+      if (name[0] == '.' || name.find(".tmp.") != std::string::npos ||
+          fstatat(dirfd(subHandle), name.c_str(), &st, 0) != 0 ||
+          !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      entries.push_back(Input{depth + "/" + name, (uint64_t)st.st_size});
+    }
+    closedir(subHandle);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Input &a, const Input &b) { return a.name < b.name; });
+    job.inputs.insert(job.inputs.end(), entries.begin(), entries.end());
+  }
+
+  ok = Merge(job, preamble + "let _typeSELF = GccType.pointer(GccType.self)\n",
+             phase) && ok;
+  return "open TypeCatalog;;\n";
+}
+}
+
+int main(int argc, char **argv) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string preamblePath = REPO_ROOT "/../../artifacts/preamble.txt";
+  uint64_t shardBytes = 0, shardInputs = 0;
+  bool verbose = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:p:s:n:vh")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = (size_t)std::max(1, atoi(optarg));
+      break;
+    case 'p':
+      preamblePath = optarg;
+      break;
+    case 's':
+      if (!ParseBudget(optarg, shardBytes)) {
+        Usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'n':
+      if (!ParseBudget(optarg, shardInputs)) {
+        Usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      Usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    Usage(argv[0]);
+    return 2;
+  }
+
+  std::string root = argv[optind];
+  while (root.size() > 1 && root.back() == '/') {
+    root.pop_back();
+  }
+  auto merged = root + "-merged";
+
+  std::string preamble;
+  if (!ReadFile(preamblePath, preamble)) {
+    std::cerr << preamblePath << ": cannot read" << std::endl;
+    return 1;
+  }
+  mkdir(merged.c_str(), 0755);
+
+  auto ok = true;
+
+  Phase scanned;
+  WorkPool scanPool(threads);
+  Scanner scanner(scanPool, scanned);
+  scanPool.Add([&]() { scanner.Scan(root, true); });
+  scanPool.Run();
+  scanned.Report("scan");
+  ok = !scanner.failed && ok;
+
+  Phase catalog;
+  preamble += MergeCatalog(root, merged, preamble, ok, catalog);
+  if (catalog.files != 0) {
+    catalog.Report("catalog");
+  }
+
+  std::vector<Job> jobs;
+  for (auto &job : scanner.jobs) {
+    job.output = merged + "/" + MergedName(job.dir);
+    for (auto &shard : Shard(std::move(job), shardBytes, shardInputs)) {
+      jobs.push_back(std::move(shard));
+    }
+  }
+
+  // Biggest first, so one huge module doesn't start last
+  std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+    return Bytes(a) > Bytes(b);
+  });
+
+  Phase merging;
+  WorkPool mergePool(threads);
+  std::mutex failures;
+  for (auto &job : jobs) {
+    mergePool.Add([&]() {
+      if (!Merge(job, preamble, merging)) {
+        std::lock_guard<std::mutex> hold(failures);
+        std::cerr << job.output << ": failed to merge" << std::endl;
+        ok = false;
+      } else if (verbose) {
+        std::lock_guard<std::mutex> hold(failures);
+        std::cerr << job.output << " <- " << job.inputs.size() << " files"
+                  << std::endl;
+      }
+    });
+  }
+  mergePool.Run();
+  merging.Report("merge");
+
+  Phase copied;
+  for (auto &input : scanner.topLevel) {
+    Job job;
+    job.dir = root;
+    job.inputs.push_back(input);
+    job.output = merged + "/" + input.name;
+    job.preamble = false;
+    if (!Merge(job, preamble, copied)) {
+      std::cerr << job.output << ": failed to copy" << std::endl;
+      ok = false;
+    }
+  }
+  auto manifest = root + "/" + MANIFEST;
+  struct stat st;
+  if (stat(manifest.c_str(), &st) == 0) {
+    Job job;
+    job.dir = root;
+    job.inputs.push_back(Input{MANIFEST, static_cast<uint64_t>(st.st_size)});
+    job.output = merged + "/" + MANIFEST;
+    job.preamble = false;
+    if (!Merge(job, preamble, copied)) {
+      std::cerr << job.output << ": failed to copy" << std::endl;
+      ok = false;
+    }
+  }
+  if (copied.files != 0) {
+    copied.Report("copy");
+  }
+
+  std::cout << jobs.size() << " merged files" << std::endl;
+  return ok ? 0 : 1;
+}
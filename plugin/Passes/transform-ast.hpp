@@ -4,78 +4,203 @@ namespace c2ocaml {
 namespace frontend {
 namespace v2 {
 
-const char * LPAREN = "(";
-const char * RPAREN = ")";
-const char * EPREFIX = "Expr.";
-const char * TPREFIX = "GccType.";
-const char * COMMA = ", ";
-const char * RAW_STR_OPEN = "\"";
-const char * RAW_STR_CLOSE = "\"";
-const char * UNSUPPORTED_EXPR = "unsupported";
-const char * UNSUPPORTED_TYPE = "unrepresentable";
-const char * START_LIST = "[|";
-const char * END_LIST = "|]";
-const char * LIST_SEP = ";";
-
-// Use this to control if we output record details 
-// (doing so can balloon the size of the generated sources 
+constexpr char LPAREN[] = "(";
+constexpr char RPAREN[] = ")";
+constexpr char EPREFIX[] = "Expr.";
+constexpr char TPREFIX[] = "GccType.";
+constexpr char COMMA[] = ", ";
+constexpr char RAW_STR_OPEN[] = "\"";
+constexpr char RAW_STR_CLOSE[] = "\"";
+constexpr char UNSUPPORTED_EXPR[] = "unsupported";
+constexpr char UNSUPPORTED_TYPE[] = "unrepresentable";
+constexpr char START_LIST[] = "[|";
+constexpr char END_LIST[] = "|]";
+constexpr char LIST_SEP[] = ";";
+
+// Every type and expression becomes one `  in let <name> = <body>` line
+constexpr char DEF_OPEN[] = "  in let ";
+constexpr char TU_DEF_OPEN[] = "let ";
+constexpr char DEF_BODY[] = " = \n    ";
+constexpr char DEF_CLOSE[] = "\n";
+
+const std::string NO_TYPE = "GccType.none";
+
+// The binding name of every node we've transformed so far (these live as
+// long as the procedure, in its arena)
+typedef util::arena_map<void*, std::string> name_map;
+
+// Use this to control if we output record details
+// (doing so can balloon the size of the generated sources
 //  but gives us more information)
 const bool NO_INGEST_RECORD_DETAILS = true;
 
-inline std::string transform_type(
+/*
+ * tu_bindings - with -fplugin-arg-c2ocaml-output=tu, every type and every
+ *               expression that doesn't depend on the procedure (constants,
+ *               globals) is defined once for the whole translation unit,
+ *               as a top-level binding in front of the procedures. Trees
+ *               are keyed by address, so the ones in here are also kept
+ *               in a GC root (see roots) or GCC could collect one between
+ *               procedures and hand its address to something else
+ */
+struct tu_bindings {
+  name_map types, exprs;
+  std::stringstream defs;
+  vec<tree, va_gc> *keep = nullptr;
+
+  // For PLUGIN_REGISTER_GGC_ROOTS
+  const ggc_root_tab roots[2] = {
+    {&keep, 1, sizeof(keep), &gt_ggc_mx_vec_tree_va_gc_,
+     &gt_pch_nx_vec_tree_va_gc_},
+    LAST_GGC_ROOT_TAB
+  };
+
+  tu_bindings() { defs << "let _typeSELF = GccType.pointer(GccType.self)\n"; }
+};
+
+// The TU's bindings (null when every procedure stands alone)
+inline tu_bindings *&shared_bindings() {
+  static tu_bindings *shared = nullptr;
+  return shared;
+}
+
+// The project's type catalog (null when types are defined where they are
+// used); it takes precedence over the TU's bindings for types
+inline util::type_catalog *&type_catalog() {
+  static util::type_catalog *catalog = nullptr;
+  return catalog;
+}
+
+// Catalog entries are shared by every TU, so nothing in them (or in what
+// refers to them) may depend on GCC's per-TU numbering. An unnamed field
+// (an anonymous struct or union member) prints as D.<uid>; in the catalog
+// it is named after its position in the record instead
+inline std::string field_name(types::gcc_tree field) {
+  if (type_catalog() == nullptr || DECL_NAME(field) != NULL_TREE ||
+      DECL_CONTEXT(field) == NULL_TREE) {
+    return gcc_str(field);
+  }
+
+  uint32_t index = 0;
+  for (auto t = TYPE_FIELDS(DECL_CONTEXT(field)); t && t != field;
+       t = DECL_CHAIN(t)) {
+    index += TREE_CODE(t) == FIELD_DECL ? 1 : 0;
+  }
+  return "D.field" + std::to_string(index);
+}
+
+// Whether an expression means the same thing in every procedure
+inline bool is_shareable(types::gcc_tree input) {
+  switch (TREE_CODE(input)) {
+    case VOID_CST:
+    case INTEGER_CST:
+    case REAL_CST:
+    case FIXED_CST:
+    case COMPLEX_CST:
+    case VECTOR_CST:
+    case STRING_CST:
+    case FUNCTION_DECL:
+      return true;
+    case VAR_DECL:
+    case CONST_DECL:
+      return DECL_FILE_SCOPE_P(input);
+    default:
+      return false;
+  }
+}
+
+inline bool is_shared(const std::ostream &out) {
+  auto shared = shared_bindings();
+  return shared != nullptr && &out == &shared->defs;
+}
+
+// The transformers below write each definition straight into its section,
+// so everything a definition refers to has to be transformed (and so
+// written) before the definition itself is started
+
+inline const std::string &transform_type(
   types::gcc_tree,
-  std::map<void*, std::string>&, 
+  name_map&,
   std::stringstream&
 );
 
-inline std::string transform_ast(
+inline const std::string &transform_ast(
   types::gcc_tree,
-  std::map<void*, std::string>&, 
-  std::map<void*, std::string>&, 
+  name_map&,
+  name_map&,
   std::stringstream&,
   std::stringstream&
 );
 
-inline std::string _transform_type(
-  types::gcc_tree input, 
-  std::map<void*, std::string>& TYPES_DONE, 
+// The name of the n-th binding with a prefix (t1, t2, ... and e1, e2, ...
+// in the order we first meet the nodes, so they don't depend on where GCC
+// happened to allocate them)
+inline std::string binding_name(const char *prefix, size_t n) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%s%zu", prefix, n);
+  return buffer;
+}
+
+// Shared definitions are top-level bindings of the module, everything
+// else goes into the procedure's let chain
+inline const char *def_open(const std::ostream &out) {
+  return is_shared(out) ? TU_DEF_OPEN : DEF_OPEN;
+}
+
+template<typename... Strings>
+inline void define(std::ostream &out, const std::string &name, Strings&&... body) {
+  concatenate_into(
+    out, def_open(out), name, DEF_BODY, std::forward<Strings>(body)..., DEF_CLOSE
+  );
+}
+
+inline void _transform_type(
+  types::gcc_tree input,
+  const std::string &self,
+  name_map& TYPES_DONE,
   std::stringstream& TYPES_BUFF
 ) {
   if (input == constants::nulltree) {
-    return concatenate(TPREFIX, "none");
+    return define(TYPES_BUFF, self, TPREFIX, "none");
   }
 
   switch (TREE_CODE(input)) {
     case OFFSET_TYPE: {
-      return concatenate(
+      auto &base = transform_type(TYPE_OFFSET_BASETYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "offset",
         LPAREN,
-        transform_type(TYPE_OFFSET_BASETYPE(input), TYPES_DONE, TYPES_BUFF),
+        base,
         COMMA,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         RPAREN
       );
     }
     case ENUMERAL_TYPE: {
-      return concatenate(
-        TPREFIX, 
-        UNSUPPORTED_TYPE, 
-        LPAREN, 
+      return define(
+        TYPES_BUFF, self,
+        TPREFIX,
+        UNSUPPORTED_TYPE,
+        LPAREN,
         RAW_STR_OPEN,
         "ENUMERAL_TYPE",
-        RAW_STR_CLOSE, 
+        RAW_STR_CLOSE,
         RPAREN
       );
     }
     case BOOLEAN_TYPE: {
-      return concatenate(
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "boolean"
       );
     }
     case INTEGER_TYPE: {
-      return concatenate(
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "integer",
         LPAREN,
@@ -83,90 +208,99 @@ inline std::string _transform_type(
         COMMA,
         std::to_string(TYPE_PRECISION(input)),
         COMMA,
-        gcc_str(TYPE_SIZE(input)),
+        util::gcc_int_str(TYPE_SIZE(input)),
         COMMA,
         "Z.of_string ",
         RAW_STR_OPEN,
-        gcc_str(TYPE_MIN_VALUE(input)),
+        util::gcc_int_str(TYPE_MIN_VALUE(input)),
         RAW_STR_CLOSE,
         COMMA,
         "Z.of_string ",
         RAW_STR_OPEN,
-        gcc_str(TYPE_MAX_VALUE(input)),
+        util::gcc_int_str(TYPE_MAX_VALUE(input)),
         RAW_STR_CLOSE,
         RPAREN
       );
     }
     case REAL_TYPE: {
-      return concatenate(
-        TPREFIX, 
-        "real", 
-        LPAREN, 
-        std::to_string(TYPE_PRECISION(input)), 
+      return define(
+        TYPES_BUFF, self,
+        TPREFIX,
+        "real",
+        LPAREN,
+        std::to_string(TYPE_PRECISION(input)),
         RPAREN
       );
     }
     case POINTER_TYPE: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "pointer",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         RPAREN
       );
     }
     case REFERENCE_TYPE: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "reference",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         RPAREN
       );
     }
     case NULLPTR_TYPE: {
-      return concatenate(
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "nullptr"
       );
     }
     case FIXED_POINT_TYPE: {
-      return concatenate(TPREFIX, UNSUPPORTED_TYPE, LPAREN, "FIXED_POINT_TYPE", RPAREN);
+      return define(TYPES_BUFF, self, TPREFIX, UNSUPPORTED_TYPE, LPAREN, "FIXED_POINT_TYPE", RPAREN);
     }
     case COMPLEX_TYPE: {
-      return concatenate(
-        TPREFIX, 
-        "complex", 
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        TYPES_BUFF, self,
+        TPREFIX,
+        "complex",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         RPAREN
       );
     }
     case VECTOR_TYPE: {
-      return concatenate(TPREFIX, UNSUPPORTED_TYPE, LPAREN, RAW_STR_OPEN, "VECTOR_TYPE", RAW_STR_CLOSE, RPAREN);
+      return define(TYPES_BUFF, self, TPREFIX, UNSUPPORTED_TYPE, LPAREN, RAW_STR_OPEN, "VECTOR_TYPE", RAW_STR_CLOSE, RPAREN);
     }
     case ARRAY_TYPE: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &domain = TYPE_DOMAIN(input) ?
+        transform_type(TYPE_DOMAIN(input), TYPES_DONE, TYPES_BUFF) : NO_TYPE;
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "array",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        TYPE_DOMAIN(input) ? transform_type(TYPE_DOMAIN(input), TYPES_DONE, TYPES_BUFF) : "GccType.none",
+        domain,
         RPAREN
       );
     }
     case UNION_TYPE:
     case RECORD_TYPE: {
-      std::stringstream vars;
-      std::stringstream fields;
-      std::stringstream types;
-      std::stringstream consts;
-
-      vars << "        (* var decls *)" << std::endl;
-      fields << "        (* field decls *)" << std::endl;
-      types << "        (* type decls *)" << std::endl;
-      consts << "        (* const decls *)" << std::endl;
+      // The details are collected on the side (their types get defined as
+      // we go, and have to come before this record's definition)
+      std::string vars = "        (* var decls *)\n";
+      std::string fields = "        (* field decls *)\n";
+      std::string types = "        (* type decls *)\n";
+      std::string consts = "        (* const decls *)\n";
 
       for (auto t = TYPE_FIELDS (input); t ; t = DECL_CHAIN (t)) {
         if (NO_INGEST_RECORD_DETAILS) {
@@ -174,13 +308,15 @@ inline std::string _transform_type(
         }
 
         if (TREE_CODE(t) == FIELD_DECL) {
-          fields << concatenate(
+          auto &type = transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF);
+          concatenate_into(
+            fields,
             "        ",
-            LPAREN, 
+            LPAREN,
             "FieldDecl.make",
-            LPAREN, 
+            LPAREN,
             RAW_STR_OPEN,
-            gcc_str(t),
+            field_name(t),
             RAW_STR_CLOSE,
             COMMA,
             RAW_STR_OPEN,
@@ -200,42 +336,51 @@ inline std::string _transform_type(
             DECL_BIT_FIELD(t) ? "true" : "false",
             RPAREN,
             COMMA,
-            transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF),
+            type,
             RPAREN,
-            LIST_SEP             
-          ) << std::endl;
+            LIST_SEP,
+            "\n"
+          );
         } else if (TREE_CODE(t) == TYPE_DECL) {
-          types << concatenate(
+          auto &type = transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF);
+          concatenate_into(
+            types,
             "        ",
-            LPAREN, 
+            LPAREN,
             RAW_STR_OPEN,
             gcc_str(t),
             RAW_STR_CLOSE,
             COMMA,
-            transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF),
+            type,
             RPAREN,
-            LIST_SEP
-          ) << std::endl;
+            LIST_SEP,
+            "\n"
+          );
         } else if (TREE_CODE(t) == CONST_DECL) {
-          consts << concatenate(
+          auto &type = transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF);
+          concatenate_into(
+            consts,
             "        ",
-            LPAREN, 
+            LPAREN,
             RAW_STR_OPEN,
             gcc_str(t),
             RAW_STR_CLOSE,
             COMMA,
-            transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF),
+            type,
             COMMA,
             DECL_INITIAL(t) ? gcc_str(DECL_INITIAL(t)) : "",
             RPAREN,
-            LIST_SEP
-          ) << std::endl;
+            LIST_SEP,
+            "\n"
+          );
         } else if (TREE_CODE(t) == VAR_DECL) {
-          vars << concatenate(
+          auto &type = transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF);
+          concatenate_into(
+            vars,
             "        ",
             LPAREN,
             "VarDecl.make",
-            LPAREN, 
+            LPAREN,
             RAW_STR_OPEN,
             gcc_str(t),
             RAW_STR_CLOSE,
@@ -245,112 +390,129 @@ inline std::string _transform_type(
             std::to_string(DECL_ALIGN(t)),
             RPAREN,
             COMMA,
-            transform_type(TREE_TYPE(t), TYPES_DONE, TYPES_BUFF),
+            type,
             RPAREN,
-            LIST_SEP
-          ) << std::endl;
+            LIST_SEP,
+            "\n"
+          );
         }
       }
 
-      return concatenate(
-        TPREFIX, 
-        TREE_CODE(input) == RECORD_TYPE ? "record" : "union", 
-        LPAREN, 
-        RAW_STR_OPEN, 
+      return define(
+        TYPES_BUFF, self,
+        TPREFIX,
+        TREE_CODE(input) == RECORD_TYPE ? "record" : "union",
+        LPAREN,
+        RAW_STR_OPEN,
         gcc_str(TYPE_NAME(input)),
-        RAW_STR_CLOSE, 
+        RAW_STR_CLOSE,
         COMMA,
         START_LIST,
         "\n",
-        vars.str(),
+        vars,
         "      ",
         END_LIST,
         COMMA,
         START_LIST,
         "\n",
-        fields.str(),
+        fields,
         "      ",
         END_LIST,
         COMMA,
         START_LIST,
         "\n",
-        types.str(),
+        types,
         "      ",
         END_LIST,
         COMMA,
         START_LIST,
         "\n",
-        consts.str(),
+        consts,
         "      ",
         END_LIST,
         RPAREN
       );
     }
     case QUAL_UNION_TYPE: {
-      return concatenate(
-        TPREFIX, 
-        UNSUPPORTED_TYPE, 
-        LPAREN, 
-        RAW_STR_OPEN, 
+      return define(
+        TYPES_BUFF, self,
+        TPREFIX,
+        UNSUPPORTED_TYPE,
+        LPAREN,
+        RAW_STR_OPEN,
         "QUAL_UNION_TYPE::",
-        gcc_str(input), 
-        RAW_STR_CLOSE, 
+        gcc_str(input),
+        RAW_STR_CLOSE,
         RPAREN
       );
     }
     case VOID_TYPE: {
-      return concatenate(
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "void"
       );
     }
     case POINTER_BOUNDS_TYPE: {
-      return concatenate(TPREFIX, UNSUPPORTED_TYPE, LPAREN, "POINTER_BOUNDS_TYPE", RPAREN);
+      return define(TYPES_BUFF, self, TPREFIX, UNSUPPORTED_TYPE, LPAREN, "POINTER_BOUNDS_TYPE", RPAREN);
     }
     case FUNCTION_TYPE: {
-      std::stringstream params;
+      std::vector<const std::string*> params;
 
-      auto varargs = true; 
+      auto varargs = true;
 
       for (auto t = TYPE_ARG_TYPES (input); t; t = TREE_CHAIN (t)) {
         if (t == void_list_node) {
           varargs = false;
           break;
         }
-        
-        params << concatenate(
-          "        ",
-          transform_type(TREE_VALUE(t), TYPES_DONE, TYPES_BUFF),
-          LIST_SEP
-        ) << std::endl;
+
+        params.push_back(&transform_type(TREE_VALUE(t), TYPES_DONE, TYPES_BUFF));
       }
 
-      return concatenate(
-        TPREFIX, 
-        "func", 
-        LPAREN, 
+      auto &result = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+
+      // (The UID is per TU; see field_name)
+      auto unnamed = type_catalog() != nullptr
+                         ? std::string("T")
+                         : "T" + std::to_string(TYPE_UID(input));
+
+      concatenate_into(
+        TYPES_BUFF,
+        def_open(TYPES_BUFF),
+        self,
+        DEF_BODY,
+        TPREFIX,
+        "func",
+        LPAREN,
         RAW_STR_OPEN,
-        TYPE_NAME(input) ? gcc_str(TYPE_NAME(input)) :
-          "T" + std::to_string(TYPE_UID(input)),
+        TYPE_NAME(input) ? gcc_str(TYPE_NAME(input)) : unnamed,
         RAW_STR_CLOSE,
         COMMA,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        result,
         COMMA,
         START_LIST,
-        "\n",
-        params.str(),
+        "\n"
+      );
+      for (auto param : params) {
+        concatenate_into(TYPES_BUFF, "        ", *param, LIST_SEP, "\n");
+      }
+      return concatenate_into(
+        TYPES_BUFF,
         "      ",
         END_LIST,
         COMMA,
         varargs ? "true" : "false",
-        RPAREN
+        RPAREN,
+        DEF_CLOSE
       );
     }
     case METHOD_TYPE: {
-      return concatenate(TPREFIX, UNSUPPORTED_TYPE, LPAREN, "METHOD_TYPE", RPAREN);
+      return define(TYPES_BUFF, self, TPREFIX, UNSUPPORTED_TYPE, LPAREN, "METHOD_TYPE", RPAREN);
     }
     case LANG_TYPE: {
-      return concatenate(
+      return define(
+        TYPES_BUFF, self,
         TPREFIX,
         "UNSUPPORTED_TYPE",
         LPAREN,
@@ -369,119 +531,119 @@ inline std::string _transform_type(
 
 // TODO: work on this file
 
-inline std::string _transform_ast(
+inline void _transform_ast(
   types::gcc_tree input,
-  std::map<void*, std::string>& TYPES_DONE, 
-  std::map<void*, std::string>& EXPRS_DONE, 
+  const std::string &self,
+  name_map& TYPES_DONE,
+  name_map& EXPRS_DONE,
   std::stringstream& TYPES_BUFF,
   std::stringstream& EXPRS_BUFF
 ) {
   if (input == constants::nulltree) {
-    return concatenate(EPREFIX, "nothing", LPAREN, "GccType.none", RPAREN);
+    return define(EXPRS_BUFF, self, EPREFIX, "nothing", LPAREN, NO_TYPE, RPAREN);
   }
 
   switch (TREE_CODE(input)) {
     /* CONSTANTS */
     case VOID_CST: {
-      return concatenate(
-        EPREFIX, 
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
+        EPREFIX,
         "void_cst",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         RPAREN
       );
     }
     case INTEGER_CST: {
-      auto asStr = gcc_str(input);
-      util::str_numeric_only(asStr);
-      if (TYPE_UNSIGNED(TREE_TYPE(input))) {
-        return concatenate(
-          EPREFIX, 
-          "u_int_cst",
-          LPAREN, 
-          transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
-          COMMA,
-          "Z.of_string ",
-          RAW_STR_OPEN,
-          asStr,
-          RAW_STR_CLOSE,
-          RPAREN
-        );
-      } else {
-        return concatenate(
-          EPREFIX, 
-          "s_int_cst",
-          LPAREN, 
-          transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
-          COMMA,
-          "Z.of_string ",
-          RAW_STR_OPEN,
-          asStr,
-          RAW_STR_CLOSE,
-          RPAREN
-        );
-      }
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
+        EPREFIX,
+        TYPE_UNSIGNED(TREE_TYPE(input)) ? "u_int_cst" : "s_int_cst",
+        LPAREN,
+        type,
+        COMMA,
+        "Z.of_string ",
+        RAW_STR_OPEN,
+        util::gcc_int_str(input),
+        RAW_STR_CLOSE,
+        RPAREN
+      );
     }
     case REAL_CST: {
-      return concatenate(
-        EPREFIX, 
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
+        EPREFIX,
         "real_cst",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
-        gcc_str(input),
+        util::gcc_real_str(input),
         RPAREN
       );
     }
     case FIXED_CST: {
       auto asStr = gcc_str(input);
       util::str_numeric_only(asStr);
-      return concatenate(
-        EPREFIX, 
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
+        EPREFIX,
         "FIXED_CST",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         asStr,
         RPAREN
       );
     }
     case COMPLEX_CST: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &real = transform_ast(TREE_REALPART(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      auto &imag = transform_ast(TREE_IMAGPART(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "COMPLEX_CST",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
-        transform_ast(TREE_REALPART(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        real,
         COMMA,
-        transform_ast(TREE_IMAGPART(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        imag,
         RPAREN
       );
     }
     case VECTOR_CST: {
-      return concatenate(
-        EPREFIX, UNSUPPORTED_EXPR, LPAREN, "VECTOR_CST", RPAREN
+      return define(
+        EXPRS_BUFF, self, EPREFIX, UNSUPPORTED_EXPR, LPAREN, "VECTOR_CST", RPAREN
       );
     }
     case STRING_CST: {
-      std::string t;
-      util::write_escaped(gcc_str(input), std::back_inserter(t));
-      return concatenate(
-        EPREFIX, 
-        "string_cst", 
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
-        COMMA,
-        std::to_string(TREE_STRING_LENGTH(input)), 
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      concatenate_into(
+        EXPRS_BUFF,
+        def_open(EXPRS_BUFF),
+        self,
+        DEF_BODY,
+        EPREFIX,
+        "string_cst",
+        LPAREN,
+        type,
         COMMA,
-        t,
-        RPAREN
+        std::to_string(TREE_STRING_LENGTH(input)),
+        COMMA
       );
+      util::write_escaped(gcc_str(input), std::ostreambuf_iterator<char>(EXPRS_BUFF));
+      return concatenate_into(EXPRS_BUFF, RPAREN, DEF_CLOSE);
     }
     /* DECLARATIONS */
     case FUNCTION_DECL: {
-      return concatenate(
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         UNSUPPORTED_EXPR,
         LPAREN,
@@ -492,11 +654,13 @@ inline std::string _transform_ast(
       );
     }
     case LABEL_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "label_decl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         RAW_STR_OPEN,
         gcc_str(input),
@@ -505,11 +669,13 @@ inline std::string _transform_ast(
       );
     }
     case RESULT_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "resultdecl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         RAW_STR_OPEN,
         gcc_str(input),
@@ -518,67 +684,69 @@ inline std::string _transform_ast(
       );
     }
     case FIELD_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "field_decl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
-        concatenate(
-          "FieldDecl.make",
-          LPAREN, 
-          RAW_STR_OPEN,
-          gcc_str(input),
-          RAW_STR_CLOSE,
-          COMMA,
-          RAW_STR_OPEN,
-          DECL_SIZE(input) ? gcc_str(DECL_SIZE(input)) : "0",
-          RAW_STR_CLOSE,
-          COMMA,
-          std::to_string(DECL_ALIGN(input)),
-          COMMA,
-          RAW_STR_OPEN,
-          DECL_FIELD_OFFSET(input) ? gcc_str(DECL_FIELD_OFFSET(input)) : "0",
-          RAW_STR_CLOSE,
-          COMMA,
-          std::to_string(DECL_OFFSET_ALIGN(input)),
-          COMMA,
-          DECL_FIELD_BIT_OFFSET(input) ? gcc_str(DECL_FIELD_BIT_OFFSET(input)) : "0",
-          COMMA,
-          DECL_BIT_FIELD(input) ? "true" : "false",
-          RPAREN
-        ),
+        "FieldDecl.make",
+        LPAREN,
+        RAW_STR_OPEN,
+        field_name(input),
+        RAW_STR_CLOSE,
+        COMMA,
+        RAW_STR_OPEN,
+        DECL_SIZE(input) ? gcc_str(DECL_SIZE(input)) : "0",
+        RAW_STR_CLOSE,
+        COMMA,
+        std::to_string(DECL_ALIGN(input)),
+        COMMA,
+        RAW_STR_OPEN,
+        DECL_FIELD_OFFSET(input) ? gcc_str(DECL_FIELD_OFFSET(input)) : "0",
+        RAW_STR_CLOSE,
+        COMMA,
+        std::to_string(DECL_OFFSET_ALIGN(input)),
+        COMMA,
+        DECL_FIELD_BIT_OFFSET(input) ? gcc_str(DECL_FIELD_BIT_OFFSET(input)) : "0",
+        COMMA,
+        DECL_BIT_FIELD(input) ? "true" : "false",
+        RPAREN,
         RPAREN
       );
     }
     case VAR_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "variable_decl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
-        concatenate(
-          "VarDecl.make",
-          LPAREN, 
-          RAW_STR_OPEN,
-          gcc_str(input),
-          RAW_STR_CLOSE,
-          COMMA,
-          DECL_SIZE(input) ? gcc_str(DECL_SIZE(input)) : "0",
-          COMMA,
-          std::to_string(DECL_ALIGN(input)),
-          RPAREN
-        ),
+        "VarDecl.make",
+        LPAREN,
+        RAW_STR_OPEN,
+        gcc_str(input),
+        RAW_STR_CLOSE,
+        COMMA,
+        DECL_SIZE(input) ? gcc_str(DECL_SIZE(input)) : "0",
+        COMMA,
+        std::to_string(DECL_ALIGN(input)),
+        RPAREN,
         RPAREN
       );
     }
     case CONST_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "const_decl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         RAW_STR_OPEN,
         gcc_str(input),
@@ -587,26 +755,31 @@ inline std::string _transform_ast(
       );
     }
     case PARM_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &argType = transform_type(DECL_ARG_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "parameter_decl",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         RAW_STR_OPEN,
         gcc_str(input),
         RAW_STR_CLOSE,
         COMMA,
-        transform_type(DECL_ARG_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        argType,
         RPAREN
       );
     }
     case TYPE_DECL: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "TYPE_DECL",
-        LPAREN, 
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        LPAREN,
+        type,
         COMMA,
         RAW_STR_OPEN,
         gcc_str(input),
@@ -616,26 +789,33 @@ inline std::string _transform_ast(
     }
     /* REFERENCES TO STORAGE */
     case COMPONENT_REF: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      auto &op1 = transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "component_ref",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op0,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op1,
         RPAREN
       );
     }
     case BIT_FIELD_REF: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "bitfield_ref",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op0,
         COMMA,
         TREE_OPERAND(input, 1) ? gcc_str(TREE_OPERAND(input, 1)) : "0",
         COMMA,
@@ -644,62 +824,78 @@ inline std::string _transform_ast(
       );
     }
     case ARRAY_REF: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      auto &op1 = transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "array_ref",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op0,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op1,
         RPAREN
       );
     }
     case MEM_REF: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      auto &op1 = transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "memory_ref",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op0,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 1), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op1,
         RPAREN
       );
     }
     case REALPART_EXPR: {
-      return concatenate(
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "real_part",
-        LPAREN, 
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        LPAREN,
+        op0,
         RPAREN
       );
     }
     case IMAGPART_EXPR: {
-      return concatenate(
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "imaginary_part",
-        LPAREN, 
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        LPAREN,
+        op0,
         RPAREN
       );
     }
     case ADDR_EXPR: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      auto &op0 = transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "address_of",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         COMMA,
-        transform_ast(TREE_OPERAND(input, 0), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF),
+        op0,
         RPAREN
       );
     }
     case VIEW_CONVERT_EXPR: {
-      return concatenate(
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         UNSUPPORTED_EXPR,
         LPAREN,
@@ -710,36 +906,55 @@ inline std::string _transform_ast(
       );
     }
     case CONSTRUCTOR: {
-      return concatenate(
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "constructor",
         LPAREN,
-        transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
+        type,
         RPAREN
       );
     }
     case SSA_NAME: {
-      return concatenate(
+      // Either there is more to this definition, or it is something like
+      // a temporary waiting to be filled during execution (and so we grab
+      // the type right away)
+      if (SSA_NAME_VAR(input)) {
+        auto &var = transform_ast(SSA_NAME_VAR(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
+        return define(
+          EXPRS_BUFF, self,
+          EPREFIX,
+          "ssa",
+          LPAREN,
+          RAW_STR_OPEN,
+          gcc_str(input),
+          RAW_STR_CLOSE,
+          COMMA,
+          std::to_string(SSA_NAME_VERSION(input)),
+          COMMA,
+          var,
+          RPAREN
+        );
+      }
+
+      auto &type = transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF);
+      return define(
+        EXPRS_BUFF, self,
         EPREFIX,
         "ssa",
-        LPAREN, 
+        LPAREN,
         RAW_STR_OPEN,
         gcc_str(input),
         RAW_STR_CLOSE,
         COMMA,
         std::to_string(SSA_NAME_VERSION(input)),
         COMMA,
-        // Either there is more to this definition, or it is something like 
-        // a temporary waiting to be filled during execution (and so we grab 
-        // the type right away)
-        SSA_NAME_VAR(input) ? transform_ast(SSA_NAME_VAR(input), TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF) : 
-          concatenate(
-            EPREFIX, 
-            "nothing", 
-            LPAREN, 
-            transform_type(TREE_TYPE(input), TYPES_DONE, TYPES_BUFF),
-            RPAREN
-          ),
+        EPREFIX,
+        "nothing",
+        LPAREN,
+        type,
+        RPAREN,
         RPAREN
       );
     }
@@ -750,46 +965,96 @@ inline std::string _transform_ast(
   }
 }
 
-inline std::string transform_type(
-  types::gcc_tree input, 
-  std::map<void*, std::string>& TYPES_DONE, 
+inline const std::string &transform_type(
+  types::gcc_tree input,
+  name_map& TYPES_DONE,
   std::stringstream& TYPES_BUFF
 ) {
-  if (TYPES_DONE.find(input) == TYPES_DONE.end()) {
-      std::ostringstream tmp, tmp2;
+  auto catalog = type_catalog();
+  if (catalog != nullptr) {
+    auto found = TYPES_DONE.find(input);
+    if (found == TYPES_DONE.end()) {
+      auto &name = TYPES_DONE[input];
+      name = "_typeSELF";
 
-      tmp << (void const *)input;
-      TYPES_DONE[input] = "_typeSELF";
+      // Written to the side (with a blank name) just to get the body; what
+      // it refers to goes to the catalog, not in here
+      std::stringstream def;
+      catalog->begin();
+      _transform_type(input, "", TYPES_DONE, def);
 
-      tmp2 << _transform_type(input, TYPES_DONE, TYPES_BUFF);
-      TYPES_BUFF << "  in let type" << tmp.str() << " = " << std::endl 
-                 << "    " << tmp2.str() << std::endl;
+      auto text = def.str();
+      auto start = strlen(DEF_OPEN) + strlen(DEF_BODY);
+      name = catalog->finish(
+        text.substr(start, text.size() - start - strlen(DEF_CLOSE))
+      );
+      found = TYPES_DONE.find(input);
+    }
+    catalog->use(found->second);
+    return found->second;
+  }
 
-      TYPES_DONE[input] = "type" + tmp.str();
+  // Types never depend on the procedure
+  auto shared = shared_bindings();
+  if (shared != nullptr && &TYPES_DONE != &shared->types) {
+    return transform_type(input, shared->types, shared->defs);
   }
 
-  return TYPES_DONE[input];
+  auto found = TYPES_DONE.find(input);
+  if (found != TYPES_DONE.end()) {
+    return found->second;
+  }
+
+  // (Map entries don't move, so this stays good while we recurse)
+  auto &name = TYPES_DONE[input];
+  name = "_typeSELF";
+  if (is_shared(TYPES_BUFF)) {
+    vec_safe_push(shared->keep, input);
+  }
+
+  auto self = binding_name("t", TYPES_DONE.size());
+  _transform_type(input, self, TYPES_DONE, TYPES_BUFF);
+
+  name = std::move(self);
+  return name;
 }
 
-inline std::string transform_ast(
+inline const std::string &transform_ast(
   types::gcc_tree input,
-  std::map<void*, std::string>& TYPES_DONE, 
-  std::map<void*, std::string>& EXPRS_DONE, 
+  name_map& TYPES_DONE,
+  name_map& EXPRS_DONE,
   std::stringstream& TYPES_BUFF,
   std::stringstream& EXPRS_BUFF
 ) {
-  if (EXPRS_DONE.find(input) == EXPRS_DONE.end()) {
-      std::ostringstream tmp, tmp2;
-      tmp << (void const *)input;
-      tmp2 << _transform_ast(
-        input, TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF
-      );
-      EXPRS_BUFF << "  in let expr" << tmp.str() << " = " << std::endl 
-                 << "    " << tmp2.str() << std::endl;
-      EXPRS_DONE[input] = "expr" + tmp.str();
+  auto shared = shared_bindings();
+  if (shared != nullptr && &EXPRS_DONE != &shared->exprs &&
+      input != constants::nulltree && is_shareable(input)) {
+    return transform_ast(
+      input, shared->types, shared->exprs, shared->defs, shared->defs
+    );
   }
 
-  return EXPRS_DONE[input];
+  auto found = EXPRS_DONE.find(input);
+  if (found != EXPRS_DONE.end()) {
+    return found->second;
+  }
+
+  // (Claim our number before the operands take theirs)
+  auto &name = EXPRS_DONE[input];
+  if (is_shared(EXPRS_BUFF)) {
+    vec_safe_push(shared->keep, input);
+  }
+
+  // (Shared ones get their own prefix; the numbers overlap)
+  auto self = binding_name(
+    is_shared(EXPRS_BUFF) ? "g" : "e", EXPRS_DONE.size()
+  );
+  _transform_ast(
+    input, self, TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF
+  );
+
+  name = std::move(self);
+  return name;
 }
 
 } // namespace v2
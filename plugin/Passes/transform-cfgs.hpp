@@ -45,20 +45,157 @@ const gcc_pass_data deposit_ecfgs_pass_data = {GIMPLE_PASS,
  */
 class transform_cfgs : public common::uw_pass {
 private:
+  EnumerationBudget budget;
+
+  // If set, every CFG we enumerate is also written here (see
+  // Paths/cfg-text.hpp) so it can be replayed with bench-paths
+  std::string dumpCfgs;
+
+  // Procedures with the same CFG shape share one enumeration (also across
+  // gcc processes if -fplugin-arg-c2ocaml-path-cache=<dir> is given)
+  PathCache pathCache;
+
+  // With -fplugin-arg-c2ocaml-output=tu the whole translation unit goes
+  // into one module (written when GCC finishes) instead of a file per
+  // procedure
+  bool tuMode = false;
+  util::tu_module tu;
+
+  // (tu mode only) Types and constant/global expressions are defined once
+  // per TU, ahead of the procedures, instead of once per procedure
+  v2::tu_bindings shared;
+
+  // With -fplugin-arg-c2ocaml-type-catalog=<dir> types are defined once
+  // for the whole project in the catalog instead (see type-catalog.hpp)
+  std::unique_ptr<util::type_catalog> catalog;
+
+  // Procedures whose IR we've already seen (in any gcc process of the
+  // ingest) aren't transformed again; -fplugin-arg-c2ocaml-dedup=0 turns
+  // that off
+  bool dedup = true;
+  util::ir_hasher hasher;
+  util::content_index contents{"/common/facts"};
+
+  // With -fplugin-arg-c2ocaml-store=<dir> procedures are also looked up
+  // in (and added to) a store shared by every ingest (not in tu mode,
+  // where procedures lean on the TU's shared definitions)
+  std::unique_ptr<util::artifact_store> store;
+
+  // Does all of our file I/O off of GCC's thread
+  std::unique_ptr<util::async_writer> writer;
+
+  // Scratch memory for whatever we build while transforming a procedure
+  // (reset after each one)
+  util::arena scratch;
+
+  // With -fplugin-arg-c2ocaml-stats=1 we report the scratch traffic of
+  // each procedure (and the totals at the end)
+  bool stats = false;
+  uint64_t scratchAllocations = 0;
+  uint64_t scratchBytes = 0;
+  uint64_t scratchMallocs = 0;
+
+  static const uint16_t MAX_UNROLL = 8;
 
 public:
   transform_cfgs(gcc_plugin_info info, gcc_plugin_version ver,
                  const std::string &proj)
       : common::uw_pass(deposit_ecfgs_pass_data, info, ver, proj) {
 
-    
+    // Limits for path enumeration (0 means unlimited). Loops are unrolled
+    // between 1 and MAX_UNROLL times; past that the unrolled CFG grows far
+    // beyond anything lsee can use
+    auto unroll = util::plugin_arg_u64(info, "unroll", 1);
+    budget.maxUnroll = (uint16_t)std::max<uint64_t>(
+        1, std::min<uint64_t>(unroll, MAX_UNROLL));
+    if (budget.maxUnroll != unroll) {
+      std::cerr << "WARN: -fplugin-arg-unroll=" + std::to_string(unroll) +
+                       " is out of range, using " +
+                       std::to_string(budget.maxUnroll) + "\n";
+    }
+    budget.maxVertices = util::plugin_arg_u64(info, "max-vertices", 0);
+    budget.maxEdges = util::plugin_arg_u64(info, "max-edges", 0);
+    budget.maxPaths = util::plugin_arg_u64(info, "max-paths", 0);
+
+    dumpCfgs = util::plugin_arg(info, "dump-cfgs");
+    pathCache = PathCache(util::plugin_arg(info, "path-cache"));
+
+    tuMode = util::plugin_arg(info, "output", "procedure") == "tu";
+    if (tuMode) {
+      v2::shared_bindings() = &shared;
+      register_callback(info->base_name, PLUGIN_REGISTER_GGC_ROOTS, NULL,
+                        (void *)shared.roots);
+    }
+
+    auto catalogDir = util::plugin_arg(info, "type-catalog");
+    if (!catalogDir.empty()) {
+      catalog.reset(new util::type_catalog(catalogDir));
+      v2::type_catalog() = catalog.get();
+    }
+
+    // How many finished procedures may wait for the disk (0 writes them
+    // synchronously)
+    writer.reset(new util::async_writer(
+        util::plugin_arg_u64(info, "write-queue", 64)));
+
+    stats = util::plugin_arg_u64(info, "stats", 0) != 0;
+    dedup = util::plugin_arg_u64(info, "dedup", 1) != 0;
+
+    // (Stored procedures would name types from some other project's
+    // catalog, so it's one or the other)
+    auto storeDir = util::plugin_arg(info, "store");
+    if (!storeDir.empty() && catalog) {
+      std::cerr << "WARN: store ignored with type-catalog\n";
+    } else if (!storeDir.empty() && !tuMode) {
+      store.reset(new util::artifact_store(
+          storeDir, "unroll=" + std::to_string(budget.maxUnroll) +
+                        " max-vertices=" + std::to_string(budget.maxVertices) +
+                        " max-edges=" + std::to_string(budget.maxEdges) +
+                        " max-paths=" + std::to_string(budget.maxPaths)));
+    }
   }
 
   ~transform_cfgs() {}
 
   inline virtual uint32_t execute(gcc_func procedure) override {
-    std::stringstream outt, outs, callstr, TYPES_BUFF, EXPRS_BUFF;
-    std::map<void*, std::string> TYPES_DONE, EXPRS_DONE;
+    uint32_t res;
+    {
+      // Nothing allocated in here may outlive this block
+      util::arena::scope use(scratch);
+      res = transform(procedure);
+    }
+
+    scratchAllocations += scratch.num_allocations();
+    scratchBytes += scratch.num_bytes();
+    scratchMallocs += scratch.num_mallocs();
+
+    if (stats && scratch.num_allocations() != 0) {
+      std::cerr << "Scratch: " + std::string(function_name(procedure)) +
+                       ": " + std::to_string(scratch.num_allocations()) +
+                       " allocations, " +
+                       std::to_string(scratch.num_bytes() / 1024) +
+                       " KiB, " + std::to_string(scratch.num_mallocs()) +
+                       " mallocs\n";
+    }
+
+    scratch.reset();
+    return res;
+  }
+
+  inline uint32_t transform(gcc_func procedure) {
+    // Printed trees are only good for one procedure
+    util::gcc_str_reset();
+
+    // Every section of the module lives in exactly one place until it is
+    // written out (in file order) at the very end
+    // (it outlives us if it is handed to the writer thread)
+    auto emitter = std::make_shared<util::ml_emitter>();
+    auto &outs = emitter->header;
+    auto &TYPES_BUFF = emitter->types;
+    auto &EXPRS_BUFF = emitter->exprs;
+    auto &callstr = emitter->calls;
+    auto &outt = emitter->body;
+    v2::name_map TYPES_DONE, EXPRS_DONE;
 
     auto transform_ast = [&](types::gcc_tree input, std::ostream & out) {
       out << v2::transform_ast(input, TYPES_DONE, EXPRS_DONE, TYPES_BUFF, EXPRS_BUFF);
@@ -124,14 +261,89 @@ public:
     util::str_replace_all(helper, "/../", "/");
     fp = helper;
 
-    if (util::fexists(fp.string())) {
-      std::cerr << fp.string() + " exists... skipping.\n";
-      return constants::GCC_EXECUTE_SUCCESS;
+    // Hashed before anything is printed (we're about to do that for
+    // nothing if it's a duplicate)
+    auto hash = dedup || store ? hasher.hash(procedure) : std::string();
+    auto reused = false;
+
+    if (tuMode) {
+      if (!tu.is_open()) {
+        // One module per TU, named like the procedures' temp names. The
+        // same file can be compiled more than once (-fPIC and not, say)
+        // into different objects, so a TU whose object isn't just named
+        // after it gets the object's name too. Nothing else goes into the
+        // name: ingesting again replaces the module
+        auto tuName = project + repocwd + "/" + main_input_basename;
+        auto stem = fs::path(main_input_basename).stem().string();
+        if (aux_base_name != nullptr && stem != aux_base_name) {
+          tuName += std::string(".") + aux_base_name;
+        }
+        util::str_replace_all(tuName, "/", "_");
+
+        fs::path tp = "/common/facts";
+        tp /= tuName + ".ml";
+
+        fs::create_directories(tp.parent_path());
+        if (!tu.open(tp.string())) {
+          std::cerr << "WARN: cannot write " + tp.string() + "\n";
+          return constants::GCC_EXECUTE_SUCCESS;
+        }
+        std::cerr << "Created: " + tp.string() + "\n";
+      }
+      fp = tu.module_path() + "#" + name;
+    } else if (!dedup) {
+      if (util::fexists(fp.string())) {
+        std::cerr << fp.string() + " exists... skipping.\n";
+        return constants::GCC_EXECUTE_SUCCESS;
+      }
+    } else {
+      // Same name, different body (another configuration of a static
+      // inline, say): keep both, the second in <name>.<h8>.ml (or under
+      // the whole hash, should even that be taken)
+      auto alternative = fp, last = fp;
+      alternative.replace_filename(name + "." + hash.substr(0, 8) + ".ml");
+      last.replace_filename(name + "." + hash + ".ml");
+
+      // The last ingest into these facts wrote this very body, and
+      // nothing has written over it since (its header and footer may be
+      // another procedure's, though: see below)
+      std::string prior;
+      if (contents.previous(hash, prior) &&
+          (prior == fp.string() || prior == alternative.string() ||
+           prior == last.string()) &&
+          util::fexists(prior) && contents.claim_path(prior, hash)) {
+        std::string owner;
+        if (!contents.claim(hash, prior, owner)) {
+          contents.record(hash, "duplicate", name, source_file_name, owner);
+          return constants::GCC_EXECUTE_SUCCESS;
+        }
+        contents.record(hash, "reused", name, source_file_name, prior);
+        std::cerr << prior + " is unchanged... reusing.\n";
+        fp = prior;
+        reused = true;
+      } else if (!contents.claim_path(fp.string(), hash)) {
+        fp = contents.claim_path(alternative.string(), hash) ? alternative
+                                                              : last;
+        contents.claim_path(fp.string(), hash);
+      }
     }
 
-    std::cerr << "Created: " + fp.string() + "\n";
+    if (dedup && !reused) {
+      std::string owner;
+      auto fresh = contents.claim(hash, fp.string(), owner);
+      contents.record(hash, fresh ? "emitted" : "duplicate", name,
+                      source_file_name, fresh ? fp.string() : owner);
 
-    fs::create_directories(fp.parent_path());
+      if (!fresh) {
+        std::cerr << fp.string() + " is a duplicate of " + owner +
+                         "... skipping.\n";
+        return constants::GCC_EXECUTE_SUCCESS;
+      }
+    }
+
+    if (!tuMode && !reused) {
+      std::cerr << "Created: " + fp.string() + "\n";
+    }
 
     outs << std::endl;
     outs << "let main = " << std::endl;
@@ -145,12 +357,32 @@ public:
     outs << "  ---------------------------------------------------------*)" << std::endl;
 
     outs << std::endl;
+    outs << util::ML_HEADER_END;
+
+    // The same body as last time, but the fid, source file, ... that go
+    // around it are this procedure's (failing that, it's transformed
+    // again)
+    if (reused && emitter->read_code_from(fp.string())) {
+      finish(emitter, procedure, name, source_file_name, fp, "", "");
+      return constants::GCC_EXECUTE_SUCCESS;
+    }
+
+    // Somebody (maybe in another project) has transformed this already
+    std::string storePath, storeKey;
+    if (store) {
+      storePath = store->path_for(hash);
+      storeKey = hasher.key();
+      if (store->load(storePath, storeKey, *emitter)) {
+        finish(emitter, procedure, name, source_file_name, fp, "", "");
+        return constants::GCC_EXECUTE_SUCCESS;
+      }
+    }
 
     // NEED TO DO ONE PRE-PASS FOR PHI/IF/SWITCH 
-    std::map<uint32_t, std::vector<
-      std::pair<std::string, std::string> > > blocksToLines;
-    std::map<uint32_t, std::vector<
-      std::pair<std::string, std::string> > > blocksToLinesEnd;
+    // (each line is its code and what we show for it when debugging)
+    typedef std::pair<util::arena_string, util::arena_string> line_t;
+    util::arena_map<uint32_t, util::arena_vector<line_t> > blocksToLines;
+    util::arena_map<uint32_t, util::arena_vector<line_t> > blocksToLinesEnd;
 
     util::for_each_bb(procedure, [&](types::gcc_bb bb, int32_t index) {
       util::for_each_stmt(bb, [&](auto gs) {
@@ -189,14 +421,14 @@ public:
           util::str_replace(asastr, "if ", ""); 
 
           blocksToLines[trueBlockIndex].push_back(
-            std::pair<std::string, std::string>(
-              trueSS.str(), 
-              "assume TRUE " + asastr
+            line_t(
+              util::arena_str(trueSS.str()), 
+              util::arena_str("assume TRUE " + asastr)
             ));
           blocksToLines[falseBlockIndex].push_back(
-            std::pair<std::string, std::string>(
-              falseSS.str(),
-              "assume FALSE " + asastr
+            line_t(
+              util::arena_str(falseSS.str()),
+              util::arena_str("assume FALSE " + asastr)
             ));
         } else if (gimple_code(gs) == GIMPLE_PHI) {
           auto input = as_a<gphi *>(gs);
@@ -218,9 +450,9 @@ public:
             tempSS << ")";
 
             blocksToLinesEnd[targetIndex].push_back(
-              std::pair<std::string, std::string>(
-                tempSS.str(), 
-                gcc_str(gimple_phi_result(input)) + " = " + gcc_str(PHI_ARG_DEF(input, i))
+              line_t(
+                util::arena_str(tempSS.str()), 
+                util::arena_str(gcc_str(gimple_phi_result(input)) + " = " + gcc_str(PHI_ARG_DEF(input, i)))
               ));
           }
         } else if (gimple_code(gs) == GIMPLE_SWITCH) {
@@ -327,8 +559,8 @@ public:
             wroteone = true;
 
             blocksToLines[targetIndex].push_back(
-              std::pair<std::string, std::string>(
-                tempSS.str(), tempDBG.str()
+              line_t(
+                util::arena_str(tempSS.str()), util::arena_str(tempDBG.str())
               ));
           }
 
@@ -336,32 +568,36 @@ public:
           defaultDBG << ")";
 
           blocksToLines[defaultBlockIndex].push_back(
-            std::pair<std::string, std::string>(defaultSS.str(), defaultDBG.str())
+            line_t(util::arena_str(defaultSS.str()), util::arena_str(defaultDBG.str()))
           );
         }
       });
     });
 
+    // Bindings are numbered in the order we emit them (steps s0.., calls
+    // c1..; see transform-ast.hpp for types and exprs) so the same
+    // procedure always comes out the same
     size_t sIndex = -1;
+    uint32_t cIndex = 0;
     util::for_each_bb(procedure, [&](types::gcc_bb bb, int32_t index) {
-      std::vector<std::string> calls;
+      util::arena_vector<util::arena_string> calls;
 
       OUTP << "  in let block_" << index << " = " << std::endl;
 
       if (index == 0) {
-        OUTP << "    let step_0_" << ++sIndex << " = Action.start " << std::endl;
+        OUTP << "    let s" << ++sIndex << " = Action.start " << std::endl;
         OUTP << "    in Block.block (" << std::endl;
         OUTP << "      " << index << "," << std::endl;
-        OUTP << "      [| step_0_" << sIndex << " |]," << std::endl;
+        OUTP << "      [| s" << sIndex << " |]," << std::endl;
         OUTP << "      [||]," << std::endl;
         OUTP << "      [| \"<ENTRY>\" |]" << std::endl;
         OUTP << "    )" << std::endl;
         return;
       } else if (index == 1) {
-        OUTP << "    let step_0_" << ++sIndex << " = Action.finish " << std::endl;
+        OUTP << "    let s" << ++sIndex << " = Action.finish " << std::endl;
         OUTP << "    in Block.block (" << std::endl;
         OUTP << "      " << index << "," << std::endl;
-        OUTP << "      [| step_0_" << sIndex << " |]," << std::endl;
+        OUTP << "      [| s" << sIndex << " |]," << std::endl;
         OUTP << "      [||]," << std::endl;
         OUTP << "      [| \"<EXIT>\" |]" << std::endl;
         OUTP << "    )" << std::endl;
@@ -369,7 +605,12 @@ public:
       }
 
       bool firsts = true;
-      std::vector<std::string> stmtstrs, dbgstrs;
+      util::arena_vector<util::arena_string> stmtstrs, dbgstrs;
+
+      auto add_step = [&]() {
+        stmtstrs.emplace_back();
+        concatenate_into(stmtstrs.back(), "s", std::to_string(sIndex));
+      };
 
       for (auto & line : blocksToLines[index]) {
         if (firsts) {
@@ -380,8 +621,8 @@ public:
         }
 
         sIndex += 1;
-        OUTP << "let step_" << index << "_" << sIndex << " = " << std::endl << line.first << std::endl;
-        stmtstrs.push_back("step_" + std::to_string(index) + "_" + std::to_string(sIndex));
+        OUTP << "let s" << sIndex << " = " << std::endl << line.first << std::endl;
+        add_step();
         dbgstrs.push_back(line.second);
       }
 
@@ -400,10 +641,10 @@ public:
         }
 
         sIndex += 1;
-        OUTP << "let step_" << index << "_" << sIndex << " = " << std::endl;
-        stmtstrs.push_back("step_" + std::to_string(index) + "_" + std::to_string(sIndex));
+        OUTP << "let s" << sIndex << " = " << std::endl;
+        add_step();
         
-        dbgstrs.push_back(gcc_str(gs));
+        dbgstrs.push_back(util::arena_str(gcc_str(gs)));
 
         switch (gimple_code(gs)) {
         case GIMPLE_ASM: {
@@ -466,25 +707,27 @@ public:
             break;
           }
 
-          calls.push_back(callName);
+          calls.push_back(util::arena_str(callName));
 
-          std::vector<std::string> argNames;
+          util::arena_vector<util::arena_string> argNames;
 
           if (gimple_call_fndecl(input)) {
             uint32_t i = 0;
             for (auto arg = DECL_ARGUMENTS(gimple_call_fndecl(input)); arg;
                  arg = DECL_CHAIN(arg), ++i) {
-              argNames.push_back(gcc_str(TREE_VALUE(arg)));
+              argNames.push_back(util::arena_str(gcc_str(TREE_VALUE(arg))));
             }
           }
 
-          callstr << "  in let call" << input << " = " << "Expr.call(" << std::endl;
+          auto callId = "c" + std::to_string(++cIndex);
+
+          callstr << "  in let " << callId << " = " << "Expr.call(" << std::endl;
           callstr << "    " << v2::transform_type(gimple_expr_type(input), TYPES_DONE, TYPES_BUFF) << "," << std::endl;
           callstr << "    \"" << callName << "\", [|" << std::endl;  
 
           for (uint32_t i = 0; i < gimple_call_num_args(input); i++) {
             if (i >= argNames.size()) {
-              argNames.push_back("p" + std::to_string(i+1));
+              argNames.push_back(util::arena_str("p" + std::to_string(i+1)));
             }
 
             callstr << "      (Expr.parameter(\""
@@ -496,16 +739,16 @@ public:
           callstr << "  |])" << std::endl;
 
           if (capturesReturn) {
-            OUTP << "      Action.call(call" << input << ")" << std::endl;
+            OUTP << "      Action.call(" << callId << ")" << std::endl;
             sIndex += 1;
-            OUTP << "    in let step_" << index << "_" << sIndex << " = " << std::endl;
-            stmtstrs.push_back("step_" + std::to_string(index) + "_" + std::to_string(sIndex));
+            OUTP << "    in let s" << sIndex << " = " << std::endl;
+            add_step();
             dbgstrs.push_back("<CAPTURES RETURN>");
             OUTP << "      Action.assign(";
             transform_ast(gimple_call_lhs(input), OUTP);
-            OUTP << ", call" << input << ")";
+            OUTP << ", " << callId << ")";
           } else {
-            OUTP << "      Action.call(call" << input << ")";
+            OUTP << "      Action.call(" << callId << ")";
           }
 
           break;
@@ -564,8 +807,8 @@ public:
         }
 
         sIndex += 1;
-        OUTP << "let step_" << index << "_" << sIndex << " = " << std::endl << line.first << std::endl;
-        stmtstrs.push_back("step_" + std::to_string(index) + "_" + std::to_string(sIndex));
+        OUTP << "let s" << sIndex << " = " << std::endl << line.first << std::endl;
+        add_step();
         dbgstrs.push_back(line.second);
       }
 
@@ -575,7 +818,7 @@ public:
         OUTP << "    in ";
       }
 
-      std::map<std::string, int> cmap;
+      util::arena_map<util::arena_string, int> cmap;
 
       for (auto & c : calls) {
         if (cmap.find(c) == cmap.end()) {
@@ -603,51 +846,111 @@ public:
       OUTP << "      |]," << std::endl;
       OUTP << "      [|" << std::endl;
       for (auto & s : dbgstrs) {
-        std::string t;
-        util::write_escaped(s, std::back_inserter(t));
-        OUTP << "        " << t << ";" << std::endl;
+        OUTP << "        ";
+        util::write_escaped(s, std::ostreambuf_iterator<char>(OUTP));
+        OUTP << ";" << std::endl;
       }
       OUTP << "      |]" << std::endl;
       OUTP << "    )" << std::endl;
 
     });
 
-    outs << "  let _typeSELF = GccType.pointer(GccType.self)" << std::endl;
-    outs << TYPES_BUFF.str();
-    outs << EXPRS_BUFF.str();
-    outs << callstr.str();
+    auto cfg = util::cfg_input(procedure);
+    cfg.name = name;
 
-    OUTP << PathEnumerator::Enumerate(procedure) << std::endl;
+    if (!dumpCfgs.empty()) {
+      fs::path dp = dumpCfgs;
+      dp /= tempName + ".cfg";
+      fs::create_directories(dp.parent_path());
 
-    OUTP << "  in Proc.proc(" << std::endl;
-    OUTP << "   \"" << name << "\"," << std::endl;
-    OUTP << "    " << procedure->funcdef_no << "," << std::endl;
-    OUTP << "   \"" << util::repo_cwd() << "\"," << std::endl;
-    OUTP << "   \"" << source_file_name << "\"," << std::endl;
-    OUTP << "   \"" << main_input_basename << "\"," << std::endl;
-    OUTP << "    cfg" << std::endl;
-    OUTP << "  )" << std::endl;
-    OUTP << "in Driver.execute main;;";
+      std::ofstream dump(dp.string(), std::ofstream::out | std::ofstream::trunc);
+      WriteCfg(dump, cfg);
+    }
 
-    outs << OUTP.str() << std::endl;
+    auto paths = pathCache.Enumerate(cfg, budget);
+    if (!paths.reason.empty()) {
+      std::cerr << "Summarized: " + fp.string() + " (" + paths.reason + ")\n";
+    }
 
-    std::ofstream outf;
-    outf.open(fp.string(), std::ofstream::out | std::ofstream::trunc);
-    
-    outf << outs.str() << std::endl;
-    
-    outf.flush();
-    outf.close();
+    OUTP << paths.cfg << std::endl;
 
+    finish(emitter, procedure, name, source_file_name, fp, storePath,
+           storeKey);
     return constants::GCC_EXECUTE_SUCCESS;
   }
 
+  // Writes the footer and hands the finished module to the writer (which
+  // owns tu from here on until deinit), and to the store (under storeKey)
+  // if storePath is set
+  inline void finish(std::shared_ptr<util::ml_emitter> emitter,
+                     gcc_func procedure, const std::string &name,
+                     const std::string &source_file_name, const fs::path &fp,
+                     const std::string &storePath,
+                     const std::string &storeKey) {
+    auto &footer = emitter->footer;
+    footer << util::ML_FOOTER_START;
+    footer << "   \"" << name << "\"," << std::endl;
+    footer << "    " << procedure->funcdef_no << "," << std::endl;
+    footer << "   \"" << util::repo_cwd() << "\"," << std::endl;
+    footer << "   \"" << source_file_name << "\"," << std::endl;
+    footer << "   \"" << main_input_basename << "\"," << std::endl;
+    footer << "    cfg" << std::endl;
+    footer << "  )" << std::endl;
+    footer << "in Driver.execute main;;" << std::endl << std::endl;
+
+    if (tuMode) {
+      auto fid = procedure->funcdef_no;
+      writer->submit([this, emitter, name, fid]() {
+        tu.add(name, fid, *emitter);
+      });
+    } else {
+      writer->submit([this, emitter, fp, storePath, storeKey]() {
+        fs::create_directories(fp.parent_path());
+        if (!emitter->write_file(fp.string())) {
+          std::cerr << "WARN: failed to write " + fp.string() + "\n";
+        }
+        if (!storePath.empty()) {
+          store->save(storePath, storeKey, *emitter);
+        }
+      });
+    }
+  }
+
   inline transform_cfgs *clone() override { return this; }
 
   inline bool init() override { return true; }
 
   inline void deinit() override {
+    writer->finish();
+    std::cerr << "Writer: " + writer->stats() + "\n";
 
+    auto opens = catalog ? util::type_catalog::module_open() : "";
+    if (tuMode && !tu.finish(opens + shared.defs.str())) {
+      std::cerr << "WARN: failed to write the module for " +
+                       std::string(main_input_basename) + "\n";
+    }
+
+    std::cerr << "Path cache: " << pathCache.Hits() << " hits, "
+              << pathCache.DiskHits() << " disk hits, " << pathCache.Misses()
+              << " misses\n";
+
+    if (store) {
+      std::cerr << "Store: " + store->stats() + "\n";
+    }
+
+    if (dedup) {
+      std::cerr << "Content: " + contents.stats() + "\n";
+    }
+
+    if (catalog) {
+      std::cerr << "Type catalog: " + catalog->stats() + "\n";
+    }
+
+    if (stats) {
+      std::cerr << "Scratch: " << scratchAllocations << " allocations, "
+                << scratchBytes / 1024 << " KiB, " << scratchMallocs
+                << " mallocs\n";
+    }
   }
 };
 }
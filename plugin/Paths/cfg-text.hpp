@@ -0,0 +1,114 @@
+/* Paths/cfg-text.hpp
+ *
+ * Description:
+ *  - A line-oriented text form of CfgInput so that CFGs dumped by the
+ *    plugin (-fplugin-arg-c2ocaml-dump-cfgs=<dir>) can be replayed through
+ *    the path enumerator without GCC:
+ *
+ *      cfg <name> <number of blocks>
+ *      e <src> <dst>                                  (one per edge)
+ *      l <header> <parent> <max latches> <n> <b1> ... <bn>  (one per loop)
+ *      end
+ */
+
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "path-enumeration.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+
+inline std::ostream &WriteCfg(std::ostream &out, const CfgInput &cfg) {
+  out << "cfg " << (cfg.name.empty() ? "-" : cfg.name) << " "
+      << cfg.numBlocks << "\n";
+
+  for (auto &edge : cfg.edges) {
+    out << "e " << edge.first << " " << edge.second << "\n";
+  }
+
+  for (auto &loop : cfg.loops) {
+    out << "l " << loop.header << " " << loop.parent << " "
+        << loop.maxLatches << " " << loop.blocks.size();
+    for (auto block : loop.blocks) {
+      out << " " << block;
+    }
+    out << "\n";
+  }
+
+  return out << "end\n";
+}
+
+// Reads the next CFG from in. Returns false at the end of the input or if
+// the CFG is malformed (and says why in err)
+inline bool ReadCfg(std::istream &in, CfgInput &cfg, std::string &err) {
+  cfg = CfgInput();
+  err.clear();
+
+  std::string line;
+  bool started = false;
+
+  auto validBlock = [&](uint32_t block) { return block < cfg.numBlocks; };
+
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string tag;
+
+    if (!(fields >> tag)) {
+      continue;
+    }
+
+    if (!started) {
+      if (tag != "cfg" || !(fields >> cfg.name >> cfg.numBlocks) ||
+          cfg.numBlocks < 2) {
+        err = "expected 'cfg <name> <blocks>', got '" + line + "'";
+        return false;
+      }
+      started = true;
+      continue;
+    }
+
+    if (tag == "e") {
+      uint32_t src, dst;
+      if (!(fields >> src >> dst) || !validBlock(src) || !validBlock(dst)) {
+        err = cfg.name + ": bad edge '" + line + "'";
+        return false;
+      }
+      cfg.edges.push_back(std::make_pair(src, dst));
+    } else if (tag == "l") {
+      CfgLoop loop;
+      size_t n;
+      if (!(fields >> loop.header >> loop.parent >> loop.maxLatches >> n) ||
+          !validBlock(loop.header) || loop.parent >= (int32_t)cfg.loops.size()) {
+        err = cfg.name + ": bad loop '" + line + "'";
+        return false;
+      }
+
+      for (size_t i = 0; i < n; ++i) {
+        uint32_t block;
+        if (!(fields >> block) || !validBlock(block)) {
+          err = cfg.name + ": bad loop '" + line + "'";
+          return false;
+        }
+        loop.blocks.push_back(block);
+      }
+      cfg.loops.push_back(loop);
+    } else if (tag == "end") {
+      return true;
+    } else {
+      err = cfg.name + ": unexpected '" + line + "'";
+      return false;
+    }
+  }
+
+  if (started) {
+    err = cfg.name + ": missing 'end'";
+  }
+  return false;
+}
+}
+} // c2ocaml::frontend
@@ -0,0 +1,178 @@
+/* Paths/path-cache.cpp
+ *
+ * Description:
+ *  - In-memory and on-disk cache of enumeration results (see
+ *    path-cache.hpp). A disk entry is written to a temporary file and
+ *    renamed into place, so concurrent gcc processes only ever see whole
+ *    entries; each entry carries its full key, so a hash collision is
+ *    just a miss
+ */
+
+#include "path-cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace c2ocaml {
+namespace frontend {
+
+namespace {
+
+// Bump whenever the enumerator's output changes so old disk entries are
+// never picked up
+const char *CACHE_VERSION = "c2ocaml-paths 1";
+
+void MakeDirs(const std::string &path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos;
+       slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+  mkdir(path.c_str(), 0755);
+}
+}
+
+std::string PathCache::Key(const CfgInput &input,
+                           const EnumerationBudget &budget) {
+  std::ostringstream key;
+
+  key << "b " << budget.maxUnroll << " " << budget.maxVertices << " "
+      << budget.maxEdges << " " << budget.maxPaths << "\n";
+  key << "n " << input.numBlocks << "\n";
+
+  // Edge order doesn't matter to the enumerator (nor does the order of
+  // blocks within a loop), but the order of the loops does
+  auto edges = input.edges;
+  std::sort(edges.begin(), edges.end());
+  for (auto &edge : edges) {
+    key << edge.first << " " << edge.second << "\n";
+  }
+
+  for (auto &loop : input.loops) {
+    auto blocks = loop.blocks;
+    std::sort(blocks.begin(), blocks.end());
+
+    key << "l " << loop.header << " " << loop.maxLatches;
+    for (auto block : blocks) {
+      key << " " << block;
+    }
+    key << "\n";
+  }
+
+  return key.str();
+}
+
+uint64_t PathCache::Hash(const std::string &key) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (auto c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string PathCache::PathFor(uint64_t hash) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%02x/%016llx",
+           static_cast<unsigned>(hash >> 56),
+           static_cast<unsigned long long>(hash));
+  return dir + "/" + name;
+}
+
+bool PathCache::Load(uint64_t hash, const std::string &key,
+                     EnumerationResult &res) {
+  std::ifstream in(PathFor(hash), std::ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  std::string version;
+  size_t keySize = 0, cfgSize = 0;
+  if (!std::getline(in, version) || version != CACHE_VERSION ||
+      !(in >> keySize) || keySize != key.size() || in.get() != '\n') {
+    return false;
+  }
+
+  std::string storedKey(keySize, '\0');
+  if (!in.read(&storedKey[0], keySize) || storedKey != key) {
+    return false;
+  }
+
+  if (!(in >> res.unroll >> res.summarized) || in.get() != '\n' ||
+      !std::getline(in, res.reason) || !(in >> cfgSize) || in.get() != '\n') {
+    return false;
+  }
+
+  res.cfg.assign(cfgSize, '\0');
+  return static_cast<bool>(in.read(&res.cfg[0], cfgSize));
+}
+
+void PathCache::Store(uint64_t hash, const std::string &key,
+                      const EnumerationResult &res) {
+  auto path = PathFor(hash);
+  MakeDirs(path.substr(0, path.rfind('/')));
+
+  auto tmp = path + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << CACHE_VERSION << "\n";
+    out << key.size() << "\n" << key;
+    out << res.unroll << " " << res.summarized << "\n";
+    out << res.reason << "\n";
+    out << res.cfg.size() << "\n" << res.cfg;
+
+    if (!out.flush()) {
+      out.close();
+      unlink(tmp.c_str());
+      return;
+    }
+  }
+
+  // Whoever renames last wins; both wrote the same thing anyway
+  if (rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+  }
+}
+
+EnumerationResult PathCache::Enumerate(const CfgInput &input,
+                                       const EnumerationBudget &budget) {
+  auto key = Key(input, budget);
+  auto hash = Hash(key);
+
+  auto &bucket = entries[hash];
+  for (auto &entry : bucket) {
+    if (entry.key == key) {
+      hits += 1;
+      return entry.result;
+    }
+  }
+
+  EnumerationResult res;
+  if (!dir.empty() && Load(hash, key, res)) {
+    diskHits += 1;
+  } else {
+    misses += 1;
+    res = PathEnumerator::Enumerate(input, budget);
+
+    if (!dir.empty()) {
+      Store(hash, key, res);
+    }
+  }
+
+  // Nothing was computed for whoever hits this later
+  Entry entry;
+  entry.key = key;
+  entry.result = res;
+  entry.result.stats = EnumerationStats();
+  bucket.push_back(entry);
+
+  return res;
+}
+}
+} // c2ocaml::frontend
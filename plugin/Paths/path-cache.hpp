@@ -0,0 +1,63 @@
+/* Paths/path-cache.hpp
+ *
+ * Description:
+ *  - Remembers enumeration results by the exact shape of the CFG (blocks,
+ *    edges, loop forest, loop bounds) and the budget, so procedures with
+ *    the same shape (static inline helpers pulled into many TUs, macro
+ *    generated accessors, ...) are only unrolled and numbered once.
+ *    Optionally shares results between gcc processes through a directory
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "path-enumeration.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+
+class PathCache {
+  struct Entry {
+    std::string key;
+    EnumerationResult result;
+  };
+
+  // Buckets by hash of the key (the key itself settles collisions)
+  std::unordered_map<uint64_t, std::vector<Entry>> entries;
+
+  // Where to share results with other processes (empty if we don't)
+  std::string dir;
+
+  uint64_t hits = 0;
+  uint64_t diskHits = 0;
+  uint64_t misses = 0;
+
+  // The canonical form of everything the enumerator's output depends on
+  static std::string Key(const CfgInput &input,
+                         const EnumerationBudget &budget);
+
+  static uint64_t Hash(const std::string &key);
+
+  std::string PathFor(uint64_t hash) const;
+  bool Load(uint64_t hash, const std::string &key, EnumerationResult &res);
+  void Store(uint64_t hash, const std::string &key,
+             const EnumerationResult &res);
+
+public:
+  explicit PathCache(const std::string &dir = "") : dir(dir) {}
+
+  // Same as PathEnumerator::Enumerate, but reuses earlier results. Block
+  // numbers are part of the key, so a hit's cfg (block_N references and
+  // all) is exactly what we would have generated
+  EnumerationResult Enumerate(const CfgInput &input,
+                              const EnumerationBudget &budget);
+
+  inline uint64_t Hits() const { return hits; }
+  inline uint64_t DiskHits() const { return diskHits; }
+  inline uint64_t Misses() const { return misses; }
+};
+}
+} // c2ocaml::frontend
@@ -0,0 +1,649 @@
+/* Paths/path-enumeration.cpp
+ *
+ * Description:
+ *  - Loop unrolling (a product of each block with the iteration indices
+ *    of its enclosing loops) and Ball-Larus numbering of the result
+ */
+
+#include "path-enumeration.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <numeric>
+#include <sstream>
+#include <tuple>
+
+namespace c2ocaml {
+namespace frontend {
+
+namespace {
+
+// Adds the wall time between construction and Stop() (or destruction)
+// to a counter
+class PhaseTimer {
+  std::chrono::steady_clock::time_point start;
+  double *total;
+
+public:
+  explicit PhaseTimer(double &counter)
+      : start(std::chrono::steady_clock::now()), total(&counter) {}
+  PhaseTimer() : start(std::chrono::steady_clock::now()), total(nullptr) {}
+
+  ~PhaseTimer() { Stop(); }
+
+  inline double Stop() {
+    auto secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    if (total != nullptr) {
+      *total += secs;
+      total = nullptr;
+    }
+    return secs;
+  }
+};
+}
+
+util::arena_vector<uint32_t>
+PathEnumerator::GeneratePrefixes(UVertTable &table, const LoopIndices &bounds,
+                                 bool isHead) {
+  auto res = util::arena_vector<uint32_t>();
+  auto depth = static_cast<uint16_t>(bounds.size());
+
+  auto bound = [&](uint16_t D) {
+    return (isHead && D == depth - 1) ? bounds[D] + 1 : bounds[D];
+  };
+
+  // No copies at all if some loop index has nothing to range over
+  for (uint16_t D = 0; D < depth; ++D) {
+    if (bound(D) == 0) {
+      return res;
+    }
+  }
+
+  // Count up like an odometer (the innermost index moves fastest)
+  auto prefix = LoopIndices(depth, 0);
+  while (true) {
+    res.push_back(table.Intern(prefix));
+
+    auto D = static_cast<int32_t>(depth) - 1;
+    while (D >= 0 && ++prefix[D] == bound(D)) {
+      prefix[D] = 0;
+      --D;
+    }
+
+    if (D < 0) {
+      break;
+    }
+  }
+
+  return res;
+}
+
+uint64_t PathEnumerator::CountPrefixes(const LoopIndices &bounds, bool isHead) {
+  uint64_t res = 1;
+  for (size_t D = 0; D < bounds.size(); ++D) {
+    uint64_t bound =
+        (isHead && D == bounds.size() - 1) ? bounds[D] + 1 : bounds[D];
+    if (__builtin_mul_overflow(res, bound, &res)) {
+      return UINT64_MAX;
+    }
+  }
+  return res;
+}
+
+LoopIndices PathEnumerator::LoopBounds(const LoopIndices &trips, uint16_t K) {
+  auto res = LoopIndices(trips.size());
+  for (size_t D = 0; D < trips.size(); ++D) {
+    res[D] = (trips[D] == 0) ? K : std::min(trips[D], K);
+  }
+  return res;
+}
+
+EnumerationResult PathEnumerator::Enumerate(const CfgInput &input,
+                                            const EnumerationBudget &budget) {
+  PhaseTimer timer;
+  EnumerationResult res;
+
+  // There are N vertices in the CFG
+  auto N = input.numBlocks;
+
+  // This will hold a mask over the possible edges in this
+  // CFG. A zero is a normal edge; a one is a loop exit edge;
+  // a two is a backedge; a three is a loop entry edge
+  // (each treated differently in our product construction)
+  EdgeMask edgeMask;
+
+  // Add all of the edges from the CFG to the map
+  util::arena_vector<util::arena_vector<uint32_t>> succs(N);
+  for (auto &edge : input.edges) {
+    edgeMask[edge] = LPL_NORMAL_EDGE;
+    succs[edge.first].push_back(edge.second);
+  }
+
+  // This is a mask over the vertices that tells us whether
+  // a given vertex is a loop head (needs special treatment)
+  util::arena_vector<bool> loopHeads(N, false);
+
+  // This is a mask over the vertices that we will use to
+  // construct our product graph
+  util::arena_vector<uint16_t> depthMask(N, 0);
+
+  // For each vertex, the most iterations each of its enclosing loops
+  // can run (outermost first; zero if we couldn't bound the loop)
+  util::arena_vector<LoopIndices> tripCounts(N);
+
+  // Which blocks are in the loop we're looking at
+  util::arena_vector<bool> inLoop(N, false);
+
+  // Use the loop forest to compute these masks (loops come outermost
+  // first, which keeps tripCounts in order)
+  for (auto &loop : input.loops) {
+    // Set it in our bitmask
+    loopHeads[loop.header] = true;
+
+    // The body runs once more than the latch (-1 means no bound)
+    uint16_t trips = (loop.maxLatches < 0 || loop.maxLatches >= UINT16_MAX - 1)
+                         ? 0
+                         : static_cast<uint16_t>(loop.maxLatches + 1);
+
+    // Update each block in our depth mask
+    // (Which means add a new index to the mask-list)
+    for (auto block : loop.blocks) {
+      depthMask[block] += 1;
+      tripCounts[block].push_back(trips);
+      inLoop[block] = true;
+
+      // Check for back-edge from this to header
+      auto found = edgeMask.find(std::make_pair(block, loop.header));
+
+      // If the edge exists then it is a back edge
+      if (found != edgeMask.end()) {
+        found->second = LPL_BACK_EDGE;
+      }
+    }
+
+    // Anything leaving the loop is an exit edge
+    for (auto block : loop.blocks) {
+      for (auto dst : succs[block]) {
+        if (!inLoop[dst]) {
+          edgeMask[std::make_pair(block, dst)] = LPL_EXIT_EDGE;
+        }
+      }
+    }
+
+    for (auto block : loop.blocks) {
+      inLoop[block] = false;
+    }
+  }
+
+  // Now we find edges incoming to loop heads
+  for (auto &edge : edgeMask) {
+    // Skip if not a loop head
+    if (!loopHeads[edge.first.second]) {
+      continue;
+    }
+
+    // Need to be going into a loop (down a level)
+    if (depthMask[edge.first.first] >= depthMask[edge.first.second]) {
+      continue;
+    }
+
+    // Else set the mask
+    edge.second = LPL_ENTRY_EDGE;
+  }
+
+  res.stats.classifySecs = timer.Stop();
+
+  // Try the biggest unroll factor we're allowed first and back off until
+  // the unrolled graph fits in our budget (loops GCC can bound more
+  // tightly than K only get as many copies as they can use)
+  for (auto K = budget.maxUnroll; K >= 1; --K) {
+    std::string why;
+    if (Unroll(N, edgeMask, depthMask, loopHeads, tripCounts, K, budget,
+               res.stats, res.cfg, why)) {
+      res.unroll = K;
+      return res;
+    }
+
+    if (res.reason.empty()) {
+      res.reason = why;
+    }
+  }
+
+  // Nothing fit, so summarize the loops: with K = 0 only the head of each
+  // outermost loop survives (once) and loop bodies are never entered
+  std::string why;
+  res.summarized = true;
+  if (Unroll(N, edgeMask, depthMask, loopHeads, tripCounts, 0, budget,
+             res.stats, res.cfg, why)) {
+    res.cfg = "  (* c2ocaml: loops summarized, " + res.reason + " *)\n" +
+              res.cfg;
+    return res;
+  }
+
+  // Even that was too big; all we can say is that we get from entry
+  // to exit somehow
+  res.reason += "; " + why;
+  res.cfg = "  (* c2ocaml: procedure summarized, " + res.reason + " *)\n"
+            "  in let cfg = Cfg.cfg (\n"
+            "    " + std::to_string(N) + ",\n"
+            "    Z.of_int 1,\n"
+            "    [|\n"
+            "      Cfg.vert (\"[0]\", block_0, [|\n"
+            "          Cfg.edge (1, \"[1]\", block_1, Z.of_int 0, Z.of_int 0);\n"
+            "        |]\n"
+            "      );\n"
+            "      Cfg.vert (\"[1]\", block_1, [|\n"
+            "        |]\n"
+            "      );\n"
+            "    |]\n"
+            "  )";
+  return res;
+}
+
+bool PathEnumerator::Unroll(
+    uint32_t N, const EdgeMask &edgeMask,
+    const util::arena_vector<uint16_t> &depthMask,
+    const util::arena_vector<bool> &loopHeads,
+    const util::arena_vector<LoopIndices> &tripCounts, uint16_t K,
+    const EnumerationBudget &budget, EnumerationStats &stats, std::string &out,
+    std::string &why) {
+  PhaseTimer timer(stats.unrollSecs);
+  stats.attempts += 1;
+
+  // Check how many vertices we'd make before making any of them
+  if (budget.maxVertices != 0) {
+    uint64_t numVerts = 0;
+    for (uint32_t i = 0; i < N; ++i) {
+      auto n = CountPrefixes(LoopBounds(tripCounts[i], K), loopHeads[i]);
+      if (__builtin_add_overflow(numVerts, n, &numVerts)) {
+        numVerts = UINT64_MAX;
+      }
+    }
+
+    if (numVerts > budget.maxVertices) {
+      why = "vertices " + std::to_string(numVerts) + " > " +
+            std::to_string(budget.maxVertices) + " at K=" +
+            std::to_string(K);
+      return false;
+    }
+  }
+
+  // Now, we can start to duplicate nodes
+  UVertTable table;
+
+  // Every (prefix, block) pair we generate, block by block. The copies
+  // of block i live in [firstCopy[i], firstCopy[i + 1]) and are sorted
+  // lexicographically by their prefixes
+  util::arena_vector<std::pair<uint32_t, uint32_t>> copies;
+  util::arena_vector<size_t> firstCopy(N + 1, 0);
+
+  // Blocks with the same loop bounds and head status share the same set
+  // of prefixes, so we only generate each set once
+  util::arena_map<std::pair<LoopIndices, bool>, util::arena_vector<uint32_t>>
+      prefixSets;
+
+  // Perform the product over all N vertices with the depth mask
+  // information we've collected (and loopHeads info too)
+  for (uint32_t i = 0; i < N; ++i) {
+    firstCopy[i] = copies.size();
+
+    // (A block outside of any loop just gets the empty prefix)
+    auto key = std::make_pair(LoopBounds(tripCounts[i], K),
+                              static_cast<bool>(loopHeads[i]));
+
+    auto found = prefixSets.find(key);
+    if (found == prefixSets.end()) {
+      found = prefixSets
+                  .emplace(key, GeneratePrefixes(table, key.first,
+                                                 key.second))
+                  .first;
+    }
+
+    // Add them to our new product graph
+    for (auto prefix : found->second) {
+      copies.push_back(std::pair<uint32_t, uint32_t>(prefix, i));
+    }
+  }
+  firstCopy[N] = copies.size();
+
+  // Hand out the dense ids in (prefix, block) order so that everything
+  // downstream can just compare ids
+  util::arena_vector<uint32_t> prefixRank(table.NumPrefixes());
+  {
+    util::arena_vector<uint32_t> byPrefix(table.NumPrefixes());
+    std::iota(byPrefix.begin(), byPrefix.end(), 0);
+    std::sort(byPrefix.begin(), byPrefix.end(),
+              [&](uint32_t p, uint32_t q) { return table.PrefixLess(p, q); });
+    for (size_t r = 0; r < byPrefix.size(); ++r) {
+      prefixRank[byPrefix[r]] = static_cast<uint32_t>(r);
+    }
+  }
+
+  util::arena_vector<size_t> order(copies.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return std::make_pair(prefixRank[copies[a].first], copies[a].second) <
+           std::make_pair(prefixRank[copies[b].first], copies[b].second);
+  });
+
+  util::arena_vector<UVert> unrolledCFG(copies.size());
+  for (auto c : order) {
+    unrolledCFG[c] = table.Add(copies[c].first, copies[c].second);
+  }
+
+  // Successors of each block in the original CFG (edgeMask is ordered
+  // by (src, dst) so these come out sorted by destination index)
+  util::arena_vector<util::arena_vector<std::pair<uint32_t, uint8_t>>> succs(
+      N);
+  for (auto &edge : edgeMask) {
+    succs[edge.first.first].push_back(
+        std::pair<uint32_t, uint8_t>(edge.first.second, edge.second));
+  }
+
+  // Finds the copies of block dst whose first L loop indices agree
+  // with the first L loop indices of v
+  auto copiesWithPrefix = [&](uint32_t dst, UVert v, size_t L) {
+    auto key = table.PrefixBegin(table.Prefix(v));
+    auto first = unrolledCFG.begin() + firstCopy[dst];
+    auto last = unrolledCFG.begin() + firstCopy[dst + 1];
+
+    first = std::lower_bound(first, last, key,
+                             [&](UVert u, const uint16_t *k) {
+                               auto p = table.PrefixBegin(table.Prefix(u));
+                               return std::lexicographical_compare(
+                                   p, p + L, k, k + L);
+                             });
+    last = std::upper_bound(first, last, key,
+                            [&](const uint16_t *k, UVert u) {
+                              auto p = table.PrefixBegin(table.Prefix(u));
+                              return std::lexicographical_compare(
+                                  k, k + L, p, p + L);
+                            });
+
+    return std::make_pair(first, last);
+  };
+
+  // The innermost loop index of v
+  auto lastIndex = [&](UVert v) {
+    return *(table.PrefixEnd(table.Prefix(v)) - 1);
+  };
+
+  // The final graph
+  UGraph uCFG;
+
+  // Walk the successors of each new vertex in the original CFG and only
+  // look at the copies of the destination that share the right prefix
+  // (this keeps us proportional to the number of edges we produce)
+  for (auto v1 : unrolledCFG) {
+    auto depth1 = table.PrefixSize(table.Prefix(v1));
+
+    for (auto &succ : succs[table.Block(v1)]) {
+      auto dst = succ.first;
+      auto depth = static_cast<size_t>(depthMask[dst]);
+
+      // Check it against our four types
+      if (succ.second == LPL_NORMAL_EDGE) {
+        // In this case they much match at their own level
+        assert(depth1 <= depth);
+        auto range = copiesWithPrefix(dst, v1, depth1);
+        for (auto v2 = range.first; v2 != range.second; ++v2) {
+          uCFG.push_back(UEdge(v1, *v2));
+        }
+      } else if (succ.second == LPL_BACK_EDGE) {
+        // In this case the destination needs to be one level
+        // ahead of the source
+        assert(depth1 <= depth);
+        auto range = copiesWithPrefix(dst, v1, depth1 - 1);
+        for (auto v2 = range.first; v2 != range.second; ++v2) {
+          if (lastIndex(v1) + 1 == lastIndex(*v2)) {
+            uCFG.push_back(UEdge(v1, *v2));
+          }
+        }
+      } else if (succ.second == LPL_EXIT_EDGE) {
+        // We always take the edge in the prefixes match
+        assert(depth <= depth1);
+        auto range = copiesWithPrefix(dst, v1, depth);
+        for (auto v2 = range.first; v2 != range.second; ++v2) {
+          uCFG.push_back(UEdge(v1, *v2));
+        }
+      } else if (succ.second == LPL_ENTRY_EDGE) {
+        // Prefixes must match and second is zero-th copy
+        assert(depth1 <= depth);
+        auto range = copiesWithPrefix(dst, v1, depth1);
+        for (auto v2 = range.first; v2 != range.second; ++v2) {
+          if (lastIndex(*v2) == 0) {
+            uCFG.push_back(UEdge(v1, *v2));
+          }
+        }
+      }
+    }
+
+    // No sense in building the rest if we're already over
+    if (budget.maxEdges != 0 && uCFG.size() > budget.maxEdges) {
+      why = "edges > " + std::to_string(budget.maxEdges) + " at K=" +
+            std::to_string(K);
+      return false;
+    }
+  }
+
+#ifdef LPL_DEBUG_GRAPH
+  std::cout << "digraph Ucfg {" << std::endl;
+  for (auto &edge : uCFG) {
+    table.Print(std::cout << "  ", edge.first) << " -> ";
+    table.Print(std::cout, edge.second) << std::endl;
+  }
+  std::cout << "}" << std::endl;
+#endif
+
+  // Return ball larus on the unrolled cfg
+  timer.Stop();
+  return BallLarus(N, table, uCFG, K, budget, stats, out, why);
+}
+
+bool PathEnumerator::BallLarus(uint32_t N, const UVertTable &table,
+                               UGraph &uCFG, uint16_t K,
+                               const EnumerationBudget &budget,
+                               EnumerationStats &stats, std::string &code,
+                               std::string &why) {
+  PhaseTimer timer(stats.countSecs);
+  auto V = table.NumVerts();
+
+  // Entry and exit nodes, we'll use these a bit (ids are handed out in
+  // (prefix, block) order and neither block is ever part of a loop)
+  const UVert en = 0;
+  const UVert ex = 1;
+  assert(table.Block(en) == 0 && table.Block(ex) == 1);
+
+  // STEP ONE: lay the graph out as forward and backward CSR arrays
+  // (the edges of v are [fwdStart[v], fwdStart[v + 1]) in fwdDst and
+  // [bwdStart[v], bwdStart[v + 1]) in bwdSrc)
+  util::arena_vector<uint32_t> fwdStart(V + 1, 0);
+  util::arena_vector<uint32_t> bwdStart(V + 1, 0);
+
+  for (auto &edge : uCFG) {
+    fwdStart[edge.first + 1] += 1;
+  }
+
+  // NOTE: we need to patch up any node that has absolutely no
+  // successors (and is NOT the exit). These are likely early
+  // terminations such as abort or assert(false) or exit()...
+  auto numEdges = uCFG.size();
+  for (size_t i = 0; i < numEdges; ++i) {
+    auto v = uCFG[i].second;
+
+    if (fwdStart[v + 1] != 0) {
+      // Has successors, good!
+      continue;
+    }
+
+    if (table.Block(v) == 1) {
+      // Is the real exit, good!
+      continue;
+    }
+
+    // Uh oh, patch this up
+    uCFG.push_back(UEdge(v, ex));
+    fwdStart[v + 1] = 1;
+  }
+
+  for (auto &edge : uCFG) {
+    bwdStart[edge.second + 1] += 1;
+  }
+
+  std::partial_sum(fwdStart.begin(), fwdStart.end(), fwdStart.begin());
+  std::partial_sum(bwdStart.begin(), bwdStart.end(), bwdStart.begin());
+
+  // Fill both directions (keeping each vertex's edges in the order we
+  // generated them, which fixes the path numbering below)
+  util::arena_vector<UVert> fwdDst(uCFG.size());
+  util::arena_vector<UVert> bwdSrc(uCFG.size());
+  {
+    util::arena_vector<uint32_t> fwdNext(fwdStart.begin(), fwdStart.end() - 1);
+    util::arena_vector<uint32_t> bwdNext(bwdStart.begin(), bwdStart.end() - 1);
+    for (auto &edge : uCFG) {
+      fwdDst[fwdNext[edge.first]++] = edge.second;
+      bwdSrc[bwdNext[edge.second]++] = edge.first;
+    }
+  }
+
+  // Path ranges, parallel to fwdDst
+  util::arena_vector<PathRange> ranges(uCFG.size(), PathRange(0, 0));
+
+  // Now we are going to walk back up from exit and number paths. The
+  // unrolled graph is acyclic, so we go in reverse topological order: a
+  // vertex is ready once all of its successors are, and each edge is
+  // looked at exactly once
+  util::arena_vector<PathCount> numPaths(V);
+  util::arena_vector<uint32_t> pending(V);
+  util::arena_vector<UVert> ready;
+
+  for (UVert v = 0; v < V; ++v) {
+    pending[v] = fwdStart[v + 1] - fwdStart[v];
+  }
+
+  // Add the exit vert
+  ready.push_back(ex);
+  numPaths[ex] = 1;
+
+  while (!ready.empty()) {
+    // Grab the next vert (its count is final)
+    auto cur = ready.back();
+    ready.pop_back();
+
+    // Push our count back to each predecessor
+    for (auto e = bwdStart[cur]; e < bwdStart[cur + 1]; ++e) {
+      auto pred = bwdSrc[e];
+      numPaths[pred] += numPaths[cur];
+
+      if (--pending[pred] == 0) {
+        ready.push_back(pred);
+      }
+    }
+  }
+
+  // Anything still pending sits on (or in front of) a cycle GCC didn't
+  // give us as a loop; those have no sensible count so leave them at zero
+  for (UVert v = 0; v < V; ++v) {
+    if (pending[v] != 0) {
+      numPaths[v] = 0;
+    }
+  }
+
+  // What this attempt costs us (table, edge list, both CSR directions,
+  // counts and ranges)
+  stats.vertices = V;
+  stats.edges = uCFG.size();
+  stats.peakBytes = std::max<uint64_t>(
+      stats.peakBytes,
+      V * (2 * sizeof(uint32_t) + 3 * sizeof(uint32_t) + sizeof(PathCount)) +
+          uCFG.size() *
+              (sizeof(UEdge) + 2 * sizeof(UVert) + sizeof(PathRange)));
+
+  // Too many paths to be worth numbering?
+  if (budget.maxPaths != 0 && numPaths[en].Exceeds(budget.maxPaths)) {
+    std::ostringstream tmp;
+    numPaths[en].Print(tmp << "paths ")
+        << " > " << budget.maxPaths << " at K=" << K;
+    why = tmp.str();
+    return false;
+  }
+
+  // Hand out path ranges; each vertex splits its count across its
+  // out-edges in order, so this is one pass over the edge array
+  for (UVert v = 0; v < V; ++v) {
+    PathCount sum = 0;
+    for (auto e = fwdStart[v]; e < fwdStart[v + 1]; ++e) {
+      // Compute a path range based on the sums
+      ranges[e] = PathRange(sum, (sum + numPaths[fwdDst[e]]).Pred());
+      // Accumulate paths count
+      sum += numPaths[fwdDst[e]];
+    }
+  }
+
+  // The vertices that make it into the output: anything with
+  // successors plus the entry and exit
+  auto emitted = [&](UVert v) {
+    return fwdStart[v] != fwdStart[v + 1] || v == en || v == ex;
+  };
+
+#ifdef LPL_DEBUG_BL
+  std::cout << "digraph {" << std::endl;
+  for (UVert v = 0; v < V; ++v) {
+    for (auto e = fwdStart[v]; e < fwdStart[v + 1]; ++e) {
+      table.Print(std::cout, v) << " -> ";
+      table.Print(std::cout, fwdDst[e]) << std::endl;
+    }
+  }
+  std::cout << "}" << std::endl;
+#endif
+
+  // Start dumping the code
+  timer.Stop();
+  PhaseTimer emitTimer(stats.emitSecs);
+  std::stringstream out;
+  util::arena_vector<int> arraypos(table.NumVerts(), 0);
+
+  // Output the cfg size and number of paths from entry to exit
+  out << "  in let cfg = Cfg.cfg (" << std::endl;
+  out << "    " << N << "," << std::endl;
+  numPaths[en].PrintZ(out << "    ") << "," << std::endl;
+  out << "    [|" << std::endl;
+
+  int idx = 0;
+  for (UVert v = 0; v < V; ++v) {
+    // Track it's array index
+    if (emitted(v)) {
+      arraypos[v] = idx;
+      idx += 1;
+    }
+  }
+
+  // Now go through the graph
+  for (UVert v = 0; v < V; ++v) {
+    if (!emitted(v)) {
+      continue;
+    }
+
+    table.Print(out << "      Cfg.vert (", v)
+        << ", block_" << table.Block(v) << ", [|" << std::endl;
+    // Dump all of the edges and path ranges
+    for (auto e = fwdStart[v]; e < fwdStart[v + 1]; ++e) {
+      table.Print(out << "          Cfg.edge (" << arraypos[fwdDst[e]] << ", ", fwdDst[e])
+          << ", block_" << table.Block(fwdDst[e]) << ", ";
+      ranges[e].first.PrintZ(out) << ", ";
+      ranges[e].second.PrintZ(out) << ");" << std::endl;
+    }
+    out << "        |]" << std::endl;
+    out << "      );" << std::endl;
+  }
+  out << "    |]" << std::endl;
+  out << "  )";
+
+  // Hand back our generated code
+  code = out.str();
+  return true;
+}
+}
+} // c2ocaml::frontend
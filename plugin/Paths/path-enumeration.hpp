@@ -0,0 +1,339 @@
+/* Paths/path-enumeration.hpp
+ *
+ * Description:
+ *  - CFG unrolling and Ball-Larus path numbering over a plain graph plus
+ *    loop forest (no GCC types). The plugin builds a CfgInput from a
+ *    gcc_func (see Utility/path-enumeration.hpp); the benchmark builds
+ *    them from serialized CFGs (see cfg-text.hpp). The unrolled graph
+ *    and everything else we build along the way lives in the active
+ *    util::arena, if there is one
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmpxx.h>
+
+#include "../Utility/arena.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+
+// An unrolled vertex is a dense id into a UVertTable
+typedef uint32_t UVert;
+typedef std::pair<UVert, UVert> UEdge;
+typedef util::arena_vector<UEdge> UGraph;
+
+// Loop iteration indices (or bounds), outermost loop first
+typedef util::arena_vector<uint16_t> LoopIndices;
+
+/*
+ * PathCount - a path count (or range endpoint) that lives in a uint64_t
+ *             and only promotes to GMP once it overflows
+ */
+class PathCount {
+  uint64_t small;
+  std::unique_ptr<mpz_class> big;
+
+  inline void Promote() {
+    if (!big) {
+      big.reset(new mpz_class());
+      mpz_import(big->get_mpz_t(), 1, 1, sizeof(small), 0, 0, &small);
+    }
+  }
+
+public:
+  // Largest value we can hand to Z.of_int (max_int on a 64-bit OCaml)
+  static const uint64_t OCAML_MAX_INT = (1ULL << 62) - 1;
+
+  PathCount(uint64_t value = 0) : small(value) {}
+
+  PathCount(const PathCount &other) : small(other.small) {
+    if (other.big) {
+      big.reset(new mpz_class(*other.big));
+    }
+  }
+
+  PathCount(PathCount &&other) = default;
+
+  inline PathCount &operator=(const PathCount &other) {
+    small = other.small;
+    big.reset(other.big ? new mpz_class(*other.big) : nullptr);
+    return *this;
+  }
+
+  PathCount &operator=(PathCount &&other) = default;
+
+  inline PathCount &operator+=(const PathCount &other) {
+    uint64_t sum;
+    if (!big && !other.big &&
+        !__builtin_add_overflow(small, other.small, &sum)) {
+      small = sum;
+      return *this;
+    }
+
+    // We either overflowed or one side is already big; do it in GMP
+    Promote();
+
+    if (other.big) {
+      *big += *other.big;
+    } else {
+      mpz_class rhs;
+      mpz_import(rhs.get_mpz_t(), 1, 1, sizeof(other.small), 0, 0,
+                 &other.small);
+      *big += rhs;
+    }
+
+    return *this;
+  }
+
+  inline PathCount operator+(const PathCount &other) const {
+    PathCount res(*this);
+    res += other;
+    return res;
+  }
+
+  // The last path id in a range that starts here
+  inline PathCount Pred() const {
+    PathCount res(*this);
+    if (!res.big && res.small > 0) {
+      res.small -= 1;
+    } else {
+      res.Promote();
+      *res.big -= 1;
+    }
+    return res;
+  }
+
+  inline bool IsZero() const { return big ? *big == 0 : small == 0; }
+
+  inline bool Exceeds(uint64_t limit) const {
+    return big ? *big > 0 : small > limit;
+  }
+
+  inline std::ostream &Print(std::ostream &out) const {
+    return big ? out << *big : out << small;
+  }
+
+  // Prints the OCaml Zarith literal for this value
+  inline std::ostream &PrintZ(std::ostream &out) const {
+    if (!big && small <= OCAML_MAX_INT) {
+      return out << "Z.of_int " << small;
+    }
+    return Print(out << "Z.of_string \"") << "\"";
+  }
+};
+
+// These are for when we introduce path numbering
+typedef std::pair<PathCount, PathCount> PathRange;
+
+/*
+ * UVertTable - interns each loop-iteration prefix once and maps the
+ *              dense id of every unrolled vertex to its (prefix, block)
+ */
+class UVertTable {
+  // All interned prefixes, back to back; prefix p lives in
+  // [prefixStart[p], prefixStart[p + 1])
+  util::arena_vector<uint16_t> prefixData;
+  util::arena_vector<uint32_t> prefixStart{0};
+  util::arena_map<LoopIndices, uint32_t> prefixIds;
+
+  // The side table (indexed by UVert)
+  util::arena_vector<uint32_t> prefixOf;
+  util::arena_vector<uint32_t> blockOf;
+
+public:
+  inline uint32_t Intern(const LoopIndices &prefix) {
+    auto found = prefixIds.find(prefix);
+    if (found != prefixIds.end()) {
+      return found->second;
+    }
+
+    auto id = static_cast<uint32_t>(prefixStart.size() - 1);
+    prefixData.insert(prefixData.end(), prefix.begin(), prefix.end());
+    prefixStart.push_back(static_cast<uint32_t>(prefixData.size()));
+    prefixIds.emplace(prefix, id);
+    return id;
+  }
+
+  inline UVert Add(uint32_t prefix, uint32_t block) {
+    prefixOf.push_back(prefix);
+    blockOf.push_back(block);
+    return static_cast<UVert>(blockOf.size() - 1);
+  }
+
+  inline size_t NumPrefixes() const { return prefixStart.size() - 1; }
+  inline size_t NumVerts() const { return blockOf.size(); }
+
+  inline uint32_t Prefix(UVert v) const { return prefixOf[v]; }
+  inline uint32_t Block(UVert v) const { return blockOf[v]; }
+
+  inline const uint16_t *PrefixBegin(uint32_t p) const {
+    return prefixData.data() + prefixStart[p];
+  }
+  inline const uint16_t *PrefixEnd(uint32_t p) const {
+    return prefixData.data() + prefixStart[p + 1];
+  }
+  inline size_t PrefixSize(uint32_t p) const {
+    return prefixStart[p + 1] - prefixStart[p];
+  }
+
+  // Lexicographic order on the interned prefixes
+  inline bool PrefixLess(uint32_t p, uint32_t q) const {
+    return std::lexicographical_compare(PrefixBegin(p), PrefixEnd(p),
+                                        PrefixBegin(q), PrefixEnd(q));
+  }
+
+  // Prints the vertex label we use in the generated code
+  inline std::ostream &Print(std::ostream &out, UVert v) const {
+    auto p = prefixOf[v];
+    if (PrefixSize(p) == 0) {
+      return out << "\"[" << blockOf[v] << "]\"";
+    }
+
+    out << "\"[";
+    for (auto i = PrefixBegin(p); i != PrefixEnd(p); ++i) {
+      out << (uint32_t)*i << " ";
+    }
+    return out << "| " << blockOf[v] << "]\"";
+  }
+};
+
+/*
+ * EnumerationBudget - limits on how big we let the unrolled graph of a
+ *                     single procedure get (zero means no limit)
+ */
+struct EnumerationBudget {
+  // The largest unroll factor (K) we try
+  uint16_t maxUnroll = 1;
+
+  uint64_t maxVertices = 0;
+  uint64_t maxEdges = 0;
+  uint64_t maxPaths = 0;
+};
+
+/*
+ * EnumerationStats - per-phase wall time (summed over every unroll factor
+ *                    we tried) and the size of the graph we numbered
+ */
+struct EnumerationStats {
+  double classifySecs = 0;
+  double unrollSecs = 0;
+  double countSecs = 0;
+  double emitSecs = 0;
+
+  // How many unroll factors we tried (including the summary)
+  uint32_t attempts = 0;
+
+  // The unrolled graph we ended up numbering
+  uint64_t vertices = 0;
+  uint64_t edges = 0;
+
+  // Largest footprint of the unrolled graph and its numbering across
+  // attempts (our arrays only, not allocator overhead)
+  uint64_t peakBytes = 0;
+};
+
+/*
+ * EnumerationResult - the generated cfg plus what we had to give up to
+ *                     get it under budget
+ */
+struct EnumerationResult {
+  // The generated `in let cfg = ...` binding
+  std::string cfg;
+
+  // The unroll factor we ended up using
+  uint16_t unroll = 0;
+
+  // Loops (or the whole procedure) had to be summarized
+  bool summarized = false;
+
+  // Why we didn't get maxUnroll (empty if we did)
+  std::string reason;
+
+  // Where the time and memory went
+  EnumerationStats stats;
+};
+
+/*
+ * CfgLoop - one natural loop of a CfgInput
+ */
+struct CfgLoop {
+  uint32_t header = 0;
+
+  // Index of the enclosing loop in CfgInput::loops (-1 if outermost)
+  int32_t parent = -1;
+
+  // Upper bound on how many times the latch runs (-1 if unknown)
+  int64_t maxLatches = -1;
+
+  // Every block in the loop, header first
+  std::vector<uint32_t> blocks;
+};
+
+/*
+ * CfgInput - a procedure's CFG as the path enumerator sees it. Block 0
+ *            is the entry and block 1 the exit (as in GCC)
+ */
+struct CfgInput {
+  std::string name;
+  uint32_t numBlocks = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+
+  // Outermost loops first (the order GCC's FOR_EACH_LOOP hands them out)
+  std::vector<CfgLoop> loops;
+};
+
+class PathEnumerator {
+  // Kinds of edges (each treated differently in our product construction)
+  static const uint8_t LPL_NORMAL_EDGE = 0;
+  static const uint8_t LPL_EXIT_EDGE = 1;
+  static const uint8_t LPL_BACK_EDGE = 2;
+  static const uint8_t LPL_ENTRY_EDGE = 3;
+
+  typedef util::arena_map<std::pair<uint32_t, uint32_t>, uint8_t> EdgeMask;
+
+  // Interns every loop-iteration prefix of a block whose enclosing loops
+  // (outermost first) get bounds[D] iterations each, and returns their ids
+  // in lexicographic order. The innermost index of a loop head gets one
+  // extra copy (the test that finally leaves the loop)
+  static util::arena_vector<uint32_t>
+  GeneratePrefixes(UVertTable &table, const LoopIndices &bounds, bool isHead);
+
+  // The number of prefixes GeneratePrefixes would hand back (saturating)
+  static uint64_t CountPrefixes(const LoopIndices &bounds, bool isHead);
+
+  // How many times we unroll each loop around a block: as many times as
+  // the loop can actually iterate, but never more than K
+  static LoopIndices LoopBounds(const LoopIndices &trips, uint16_t K);
+
+  // Unrolls every loop (at most) K times and numbers the paths through
+  // the result into out. Returns false (and says why) if we blow the budget
+  static bool Unroll(uint32_t N, const EdgeMask &edgeMask,
+                     const util::arena_vector<uint16_t> &depthMask,
+                     const util::arena_vector<bool> &loopHeads,
+                     const util::arena_vector<LoopIndices> &tripCounts,
+                     uint16_t K, const EnumerationBudget &budget,
+                     EnumerationStats &stats, std::string &out,
+                     std::string &why);
+
+  static bool BallLarus(uint32_t N, const UVertTable &table, UGraph &uCFG,
+                        uint16_t K, const EnumerationBudget &budget,
+                        EnumerationStats &stats, std::string &code,
+                        std::string &why);
+
+public:
+  static EnumerationResult
+  Enumerate(const CfgInput &input,
+            const EnumerationBudget &budget = EnumerationBudget());
+};
+}
+} // c2ocaml::frontend
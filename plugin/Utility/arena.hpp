@@ -0,0 +1,235 @@
+/* Utility/arena.hpp
+ *
+ * Description:
+ *  - A monotonic arena for the short-lived state of one procedure (memo
+ *    maps, per-block lines, the path enumerator's graph, ...). Allocation
+ *    is a pointer bump, freeing is a no-op and everything goes at once
+ *    when the arena is reset; its blocks are kept for the next procedure,
+ *    so in steady state a procedure costs no malloc traffic at all.
+ *    Containers use it through arena_allocator, which picks up whichever
+ *    arena is active (see arena::scope) and falls back to the heap when
+ *    there is none. No GCC types in here (the path enumerator uses it too)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class arena {
+  struct block {
+    block *next;
+    size_t size;
+  };
+
+  // Normal blocks (all blockSize) are kept across resets, anything
+  // bigger gets a block of its own that goes away on reset
+  size_t blockSize;
+  block *blocks = nullptr;
+  block *current = nullptr;
+  block *oversized = nullptr;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+
+  // Since the last reset
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  uint64_t mallocs = 0;
+
+  inline static char *start_of(block *b) {
+    return reinterpret_cast<char *>(b) + sizeof(block);
+  }
+
+  inline block *new_block(size_t size) {
+    auto b = static_cast<block *>(malloc(sizeof(block) + size));
+    if (b == nullptr) {
+      throw std::bad_alloc();
+    }
+    b->next = nullptr;
+    b->size = size;
+    mallocs += 1;
+    return b;
+  }
+
+  // Makes the next normal block current (reusing one if we have it)
+  inline void next_block() {
+    if (current != nullptr && current->next != nullptr) {
+      current = current->next;
+    } else {
+      auto b = new_block(blockSize);
+      if (current == nullptr) {
+        blocks = b;
+      } else {
+        current->next = b;
+      }
+      current = b;
+    }
+    cursor = start_of(current);
+    limit = cursor + current->size;
+  }
+
+  inline static char *align_up(char *p, size_t align) {
+    auto at = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char *>((at + align - 1) & ~(uintptr_t)(align - 1));
+  }
+
+public:
+  explicit arena(size_t blockSize = 256 * 1024) : blockSize(blockSize) {}
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  ~arena() {
+    reset();
+    for (auto b = blocks; b != nullptr;) {
+      auto next = b->next;
+      free(b);
+      b = next;
+    }
+  }
+
+  inline void *allocate(size_t n, size_t align) {
+    allocations += 1;
+    bytes += n;
+
+    // Big requests don't get to waste the rest of a normal block
+    if (n > blockSize / 4) {
+      auto b = new_block(n + align);
+      b->next = oversized;
+      oversized = b;
+      return align_up(start_of(b), align);
+    }
+
+    auto at = align_up(cursor, align);
+    if (cursor == nullptr || at + n > limit) {
+      next_block();
+      at = align_up(cursor, align);
+    }
+    cursor = at + n;
+    return at;
+  }
+
+  // Only the most recent allocation can actually be given back
+  inline void deallocate(void *p, size_t n) {
+    if (static_cast<char *>(p) + n == cursor) {
+      cursor = static_cast<char *>(p);
+    }
+  }
+
+  // Everything allocated so far is gone
+  inline void reset() {
+    for (auto b = oversized; b != nullptr;) {
+      auto next = b->next;
+      free(b);
+      b = next;
+    }
+    oversized = nullptr;
+
+    current = blocks;
+    cursor = current ? start_of(current) : nullptr;
+    limit = current ? cursor + current->size : nullptr;
+
+    allocations = 0;
+    bytes = 0;
+    mallocs = 0;
+  }
+
+  // Since the last reset: allocations we served, the bytes they asked
+  // for and how many of them actually had to go to malloc
+  inline uint64_t num_allocations() const { return allocations; }
+  inline uint64_t num_bytes() const { return bytes; }
+  inline uint64_t num_mallocs() const { return mallocs; }
+
+  // The arena arena_allocators pick up (null means the heap)
+  inline static arena *&active() {
+    static thread_local arena *active = nullptr;
+    return active;
+  }
+
+  /*
+   * scope - makes an arena the active one until it goes out of scope
+   *         (then the previous one is active again). Nothing allocated
+   *         from the arena may be used after it is reset
+   */
+  class scope {
+    arena *previous;
+
+  public:
+    explicit scope(arena &a) : previous(active()) { active() = &a; }
+    ~scope() { active() = previous; }
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+  };
+};
+
+/*
+ * arena_allocator - a standard allocator over the arena that was active
+ *                   when it was made (or the heap)
+ */
+template <typename T> class arena_allocator {
+  template <typename U> friend class arena_allocator;
+
+  arena *owner;
+
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  arena_allocator() : owner(arena::active()) {}
+
+  template <typename U>
+  arena_allocator(const arena_allocator<U> &other) : owner(other.owner) {}
+
+  inline T *allocate(size_t n) {
+    if (owner == nullptr) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T *>(owner->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  inline void deallocate(T *p, size_t n) {
+    if (owner == nullptr) {
+      ::operator delete(p);
+    } else {
+      owner->deallocate(p, n * sizeof(T));
+    }
+  }
+
+  template <typename U>
+  inline bool operator==(const arena_allocator<U> &other) const {
+    return owner == other.owner;
+  }
+
+  template <typename U>
+  inline bool operator!=(const arena_allocator<U> &other) const {
+    return owner != other.owner;
+  }
+};
+
+template <typename T> using arena_vector = std::vector<T, arena_allocator<T>>;
+
+template <typename K, typename V, typename Less = std::less<K>>
+using arena_map =
+    std::map<K, V, Less, arena_allocator<std::pair<const K, V>>>;
+
+typedef std::basic_string<char, std::char_traits<char>, arena_allocator<char>>
+    arena_string;
+
+inline arena_string arena_str(const std::string &s) {
+  return arena_string(s.data(), s.size());
+}
+}
+}
+} // c2ocaml::frontend::util
@@ -0,0 +1,122 @@
+/* Utility/artifact-store.hpp
+ *
+ * Description:
+ *  - A store of transformed procedures shared by every ingest
+ *    (-fplugin-arg-c2ocaml-store=<dir>, /common/store in the corpus), so
+ *    code that projects vendor (lua, jemalloc, compat shims, the kernel's
+ *    core across configs) is transformed once. Entries are named by IR
+ *    hash (see ir-hash.hpp) plus everything else the output depends on,
+ *    and hold the full IR key (a collision of the hash is a miss) and the
+ *    part of a module that doesn't say which procedure it is (see
+ *    ml_emitter::write_code_to); the header and footer are always
+ *    generated fresh. Entries are written to a temporary file and renamed
+ *    into place, so concurrent processes only ever see whole entries
+ */
+
+#pragma once
+
+#include "emitter.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class artifact_store {
+  std::string dir;
+
+  // Bump whenever the transformer's output changes so old entries are
+  // never picked up
+  const char *STORE_VERSION = "c2ocaml-store 2";
+
+  // Everything besides the IR that decides what we generate (and a hash
+  // of it, which goes into entry names)
+  std::string options;
+  std::string optionsKey;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  std::atomic<uint64_t> stored{0};
+
+public:
+  artifact_store(const std::string &dir, const std::string &options)
+      : dir(dir), options(options) {
+    // FNV-1a
+    uint64_t key = 14695981039346656037ULL;
+    for (auto c : options) {
+      key = (key ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+
+    char hex[24];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+    optionsKey = hex;
+  }
+
+  inline std::string path_for(const std::string &hash) const {
+    return dir + "/" + hash.substr(0, 2) + "/" + hash + "." + optionsKey;
+  }
+
+  // Fills in the emitter's code from the store, if it's there under this
+  // key (see ir_hasher::key)
+  inline bool load(const std::string &path, const std::string &key,
+                   ml_emitter &emitter) {
+    std::ifstream in(path, std::ifstream::in | std::ifstream::binary);
+
+    std::string version, storedOptions, keySize;
+    if (!in || !std::getline(in, version) || version != STORE_VERSION ||
+        !std::getline(in, storedOptions) || storedOptions != options ||
+        !std::getline(in, keySize) || keySize != std::to_string(key.size())) {
+      misses += 1;
+      return false;
+    }
+
+    std::string storedKey(key.size(), '\0');
+    if (!in.read(&storedKey[0], storedKey.size()) || storedKey != key) {
+      misses += 1;
+      return false;
+    }
+
+    if (in.peek() != std::ifstream::traits_type::eof()) {
+      emitter.body << in.rdbuf();
+    }
+    hits += 1;
+    return true;
+  }
+
+  // (Runs on the writer thread)
+  inline void save(const std::string &path, const std::string &key,
+                   ml_emitter &emitter) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    auto tmp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream out(tmp, std::ofstream::out | std::ofstream::trunc |
+                                 std::ofstream::binary);
+      out << STORE_VERSION << "\n" << options << "\n" << key.size() << "\n";
+      out << key;
+      emitter.write_code_to(out);
+
+      if (!out.flush()) {
+        out.close();
+        unlink(tmp.c_str());
+        return;
+      }
+    }
+
+    // Whoever renames last wins; both wrote the same thing anyway (bar a
+    // collision, which the loser's next load sees as a miss)
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return;
+    }
+    stored += 1;
+  }
+
+  inline std::string stats() const {
+    return std::to_string(hits) + " reused, " + std::to_string(misses) +
+           " transformed, " + std::to_string(stored) + " stored";
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
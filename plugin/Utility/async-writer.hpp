@@ -0,0 +1,116 @@
+/* Utility/async-writer.hpp
+ *
+ * Description:
+ *  - Runs file I/O for finished procedures on a thread of its own so GCC
+ *    doesn't wait on slow (overlay, bind mounted) filesystems. Jobs run
+ *    in the order they were submitted. The queue is bounded: if the disk
+ *    can't keep up the compiler blocks in submit (and we count how long).
+ *    Jobs must not touch anything of GCC's
+ */
+
+#pragma once
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class async_writer {
+  typedef std::chrono::steady_clock clock;
+
+  // Zero means we don't use a thread at all
+  size_t capacity;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::function<void()>> jobs;
+  std::thread worker;
+  bool stopping = false;
+
+  // Counters (guarded by lock)
+  uint64_t submitted = 0;
+  size_t maxDepth = 0;
+  double stallSecs = 0;
+  double busySecs = 0;
+
+  inline static double since(clock::time_point start) {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  }
+
+  inline void run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      changed.wait(guard, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+
+      auto job = std::move(jobs.front());
+      jobs.pop_front();
+      changed.notify_all();
+
+      guard.unlock();
+      auto start = clock::now();
+      job();
+      auto secs = since(start);
+      guard.lock();
+
+      busySecs += secs;
+    }
+  }
+
+public:
+  explicit async_writer(size_t capacity) : capacity(capacity) {}
+
+  ~async_writer() { finish(); }
+
+  inline void submit(std::function<void()> job) {
+    if (capacity == 0) {
+      auto start = clock::now();
+      job();
+      submitted += 1;
+      busySecs += since(start);
+      return;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    if (!worker.joinable()) {
+      worker = std::thread([this] { run(); });
+    }
+
+    // Wait for room (this is the time the compiler loses to I/O)
+    if (jobs.size() >= capacity) {
+      auto start = clock::now();
+      changed.wait(guard, [&] { return jobs.size() < capacity; });
+      stallSecs += since(start);
+    }
+
+    jobs.push_back(std::move(job));
+    submitted += 1;
+    maxDepth = std::max(maxDepth, jobs.size());
+    changed.notify_all();
+  }
+
+  // Runs everything still queued and stops the thread
+  inline void finish() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+      changed.notify_all();
+    }
+
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+
+  inline std::string stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return std::to_string(submitted) + " jobs, max queue depth " +
+           std::to_string(maxDepth) + "/" + std::to_string(capacity) +
+           ", compiler stalled " + std::to_string(stallSecs * 1000) +
+           " ms, writing " + std::to_string(busySecs * 1000) + " ms";
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
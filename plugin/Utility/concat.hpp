@@ -39,6 +39,19 @@ namespace detail {
     return string_size_impl<string_t>::size(s);
   }
 
+  // Where a piece's characters are (arrays decay to the const char* one)
+  inline const char* string_data(const char* s) { return s ? s : ""; }
+  inline const char* string_data(const std::string& s) { return s.data(); }
+
+  template<typename Alloc>
+  inline void append_to(std::basic_string<char, std::char_traits<char>, Alloc>& out,
+                        const char* s, size_t n) {
+    out.append(s, n);
+  }
+  inline void append_to(std::ostream& out, const char* s, size_t n) {
+    out.write(s, n);
+  }
+
   template<typename...>
   struct concatenate_impl;
 
@@ -46,6 +59,10 @@ namespace detail {
   struct concatenate_impl<String> {
     static size_t size(String&& s) { return string_size(s); }
     static void concatenate(std::string& result, String&& s) { result += s; }
+    template<typename Out>
+    static void append(Out& out, String&& s) {
+      append_to(out, string_data(s), string_size(s));
+    }
   };
 
   template<typename String, typename... Rest>
@@ -58,6 +75,11 @@ namespace detail {
       result += s;
       concatenate_impl<Rest...>::concatenate(result, std::forward<Rest>(rest)...);
     }
+    template<typename Out>
+    static void append(Out& out, String&& s, Rest&&... rest) {
+      append_to(out, string_data(s), string_size(s));
+      concatenate_impl<Rest...>::append(out, std::forward<Rest>(rest)...);
+    }
   };
   
 } // namespace detail
@@ -69,3 +91,11 @@ std::string concatenate(Strings&&... strings) {
   detail::concatenate_impl<Strings...>::concatenate(result, std::forward<Strings>(strings)...);
   return result;
 }
+
+// Same as concatenate, but appends straight onto out (a string with any
+// allocator, or an std::ostream) instead of building a new string: nothing
+// is allocated and every character is copied exactly once
+template<typename Out, typename... Strings>
+void concatenate_into(Out& out, Strings&&... strings) {
+  detail::concatenate_impl<Strings...>::append(out, std::forward<Strings>(strings)...);
+}
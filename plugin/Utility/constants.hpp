@@ -21,6 +21,10 @@ const int32_t GCC_PLUGIN_SUCCESS = 0;
 const uint32_t GCC_EXECUTE_SUCCESS = 0;
 
 const types::gcc_tree nulltree = 0;
+
+// artifacts/preamble.txt, what merge-sources prepends (generated from it
+// by the build)
+#include "preamble.hpp"
 }
 }
 } // c2ocaml::frontend::constants
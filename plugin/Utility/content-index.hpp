@@ -0,0 +1,159 @@
+/* Utility/content-index.hpp
+ *
+ * Description:
+ *  - Which procedure bodies (by IR hash, see ir-hash.hpp) have been
+ *    transformed anywhere in the ingest. The first gcc process to create
+ *    <facts>/.content/<hash> (with link(2), so exactly one wins) transforms
+ *    the body; the marker holds the path it goes to, and everyone else
+ *    skips it. Every procedure gets a line in <facts>/manifest.tsv
+ *    (hash, emitted or duplicate, name, source file, the path the body is
+ *    in), appended with a single write so lines from concurrent processes
+ *    don't interleave. Output paths are claimed the same way (the marker
+ *    holds the hash of the body that got the path), so two bodies never
+ *    end up in one file.
+ *  - Re-ingesting into the same facts (a commit series, say), the last
+ *    run's markers say where each body went; a procedure whose body is
+ *    unchanged keeps that file and isn't transformed at all
+ */
+
+#pragma once
+
+#include "general-helpers.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class content_index {
+  std::string contentDir;
+  std::string pathsDir;
+  std::string previousDir;
+  std::string manifestPath;
+  bool hasPrevious;
+
+  uint64_t emitted = 0;
+  uint64_t duplicates = 0;
+  uint64_t reused = 0;
+
+  inline static std::string read_marker(const std::string &path) {
+    std::ifstream in(path, std::ifstream::in | std::ifstream::binary);
+    std::string contents;
+    std::getline(in, contents);
+    return contents;
+  }
+
+  // Creates dir/name holding contents unless it exists (then existing is
+  // what it holds). A marker that can't be made at all counts as ours
+  inline static bool make_marker(const std::string &dir,
+                                 const std::string &name,
+                                 const std::string &contents,
+                                 std::string &existing) {
+    auto marker = dir + "/" + name;
+    auto tmp = marker + ".tmp." + std::to_string(getpid());
+
+    // Written aside and linked into place, so whoever reads a marker
+    // reads all of it
+    auto write_tmp = [&]() {
+      std::ofstream out(tmp, std::ofstream::out | std::ofstream::trunc);
+      out << contents << "\n";
+      return static_cast<bool>(out.flush());
+    };
+    if (!write_tmp()) {
+      std::error_code ec;
+      fs::create_directories(dir, ec);
+      write_tmp();
+    }
+
+    auto linked = link(tmp.c_str(), marker.c_str());
+    auto error = errno;
+    unlink(tmp.c_str());
+
+    if (linked != 0 && error == EEXIST) {
+      existing = read_marker(marker);
+      return false;
+    }
+    return true;
+  }
+
+public:
+  explicit content_index(const std::string &facts)
+      : contentDir(facts + "/.content"), pathsDir(contentDir + "/paths"),
+        previousDir(facts + "/.content.prev"),
+        manifestPath(facts + "/manifest.tsv"),
+        hasPrevious(fexists(previousDir)) {}
+
+  // True if the body is ours to transform (to path); otherwise owner is
+  // where it went
+  inline bool claim(const std::string &hash, const std::string &path,
+                    std::string &owner) {
+    if (!make_marker(contentDir, hash, path, owner)) {
+      duplicates += 1;
+      return false;
+    }
+    return true;
+  }
+
+  // True if nobody but the body hashed owner writes to path in this
+  // ingest (the marker holds the hash of the body that got it)
+  inline bool claim_path(const std::string &path, const std::string &owner) {
+    // FNV-1a
+    uint64_t key = 14695981039346656037ULL;
+    for (auto c : path) {
+      key = (key ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+    std::string existing;
+    return make_marker(pathsDir, name, owner, existing) || existing == owner;
+  }
+
+  // Where the body was written by the previous ingest into these facts
+  // (the entrypoint keeps its markers in .content.prev), if anywhere
+  inline bool previous(const std::string &hash, std::string &path) const {
+    if (!hasPrevious) {
+      return false;
+    }
+    path = read_marker(previousDir + "/" + hash);
+    return !path.empty();
+  }
+
+  inline bool has_previous() const { return hasPrevious; }
+
+  // status is emitted, reused (the previous ingest's file is still good)
+  // or duplicate
+  inline void record(const std::string &hash, const char *status,
+                     const std::string &name, const std::string &source,
+                     const std::string &path) {
+    if (!strcmp(status, "emitted")) {
+      emitted += 1;
+    } else if (!strcmp(status, "reused")) {
+      reused += 1;
+    }
+
+    auto line = hash + "\t" + status + "\t" + name + "\t" + source + "\t" +
+                path + "\n";
+
+    auto fd = open(manifestPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      return;
+    }
+    auto written = write(fd, line.data(), line.size());
+    UNUSED(written);
+    close(fd);
+  }
+
+  inline std::string stats() const {
+    auto res = std::to_string(emitted) + " emitted, " +
+               std::to_string(duplicates) + " duplicates skipped";
+    if (hasPrevious) {
+      res += "; incremental: " + std::to_string(reused) + " reused, " +
+             std::to_string(emitted) + " regenerated";
+    }
+    return res;
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
@@ -0,0 +1,94 @@
+/* Utility/emitter.hpp
+ *
+ * Description:
+ *  - Holds the sections of a generated OCaml module while a procedure is
+ *    being transformed (types and exprs grow as the body is generated but
+ *    have to come first) and writes them out in their final order without
+ *    ever gluing them together in memory
+ */
+
+#pragma once
+
+#include "types.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+// The line a module's header ends with and the one its footer starts with
+constexpr char ML_HEADER_END[] =
+    "  let _typeSELF = GccType.pointer(GccType.self)\n";
+constexpr char ML_FOOTER_START[] = "  in Proc.proc(\n";
+
+class ml_emitter {
+  // Big enough that a typical procedure is one write(2)
+  static const size_t FILE_BUFFER_SIZE = 1024 * 1024;
+
+  // (Streaming a section leaves it read to the end; rewinding first lets
+  // the same emitter be written more than once)
+  inline static void write_section(std::ostream &out, std::stringstream &s) {
+    // (Streaming an empty buffer would set failbit on out)
+    if (s.tellp() > 0) {
+      s.seekg(0);
+      out << s.rdbuf();
+    }
+  }
+
+public:
+  // The sections, in the order they end up in the file. Only the header
+  // and footer say which procedure this is
+  std::stringstream header, types, exprs, calls, body, footer;
+
+  inline std::ostream &write_to(std::ostream &out) {
+    for (auto section : {&header, &types, &exprs, &calls, &body, &footer}) {
+      write_section(out, *section);
+    }
+    return out;
+  }
+
+  // Everything between the header and the footer
+  inline std::ostream &write_code_to(std::ostream &out) {
+    for (auto section : {&types, &exprs, &calls, &body}) {
+      write_section(out, *section);
+    }
+    return out;
+  }
+
+  // Takes the code of a module written out earlier back into body (see
+  // ML_HEADER_END), so it can go out again under a new header and footer
+  inline bool read_code_from(const std::string &path) {
+    std::ifstream in(path, std::ifstream::in | std::ifstream::binary);
+    std::stringstream old;
+    if (!in || !(old << in.rdbuf())) {
+      return false;
+    }
+
+    auto text = old.str();
+    auto start = text.find(ML_HEADER_END);
+    auto end = text.rfind(ML_FOOTER_START);
+    if (start == std::string::npos || end == std::string::npos ||
+        end < start + sizeof(ML_HEADER_END) - 1) {
+      return false;
+    }
+
+    start += sizeof(ML_HEADER_END) - 1;
+    body.write(text.data() + start, end - start);
+    return true;
+  }
+
+  inline bool write_file(const std::string &path) {
+    std::vector<char> buffer(FILE_BUFFER_SIZE);
+
+    // The buffer has to be in place before the file is opened
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    out.open(path, std::ofstream::out | std::ofstream::trunc);
+
+    write_to(out);
+    out.close();
+    return !out.fail();
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
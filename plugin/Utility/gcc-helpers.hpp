@@ -7,17 +7,65 @@ namespace c2ocaml {
 namespace frontend {
 namespace util {
 
-inline std::string gcc_str(gimple *g, bool is_seq = false) {
-  // We need some temporary space
-  static const int SIZE = 1024 * 1024;
-  static char buffer[SIZE];
+/*
+ * print_buffer - a FILE* over memory for GCC's pretty printers. The memory
+ *                grows as needed and is kept between uses; starting a
+ *                new print just rewinds it
+ */
+class print_buffer {
+  char *data = nullptr;
+  size_t size = 0;
+  FILE *stream = nullptr;
+
+public:
+  ~print_buffer() {
+    if (stream != nullptr) {
+      fclose(stream);
+    }
+    free(data);
+  }
 
-  // Clear buffer
-  memset(buffer, 0, SIZE);
+  // A stream positioned at the start of the (now empty) buffer
+  inline FILE *begin() {
+    if (stream == nullptr) {
+      stream = open_memstream(&data, &size);
+    } else {
+      fseeko(stream, 0, SEEK_SET);
+    }
+    return stream;
+  }
 
-  // Get a in-memory file descriptor to put
-  // the string in
-  auto mem = fmemopen(buffer, SIZE, "w");
+  // Everything printed since begin(), minus the newline GCC ends with
+  inline std::string take() {
+    fflush(stream);
+
+    auto length = size;
+    if (length > 0 && data[length - 1] == '\n') {
+      length -= 1;
+    }
+    return std::string(data, length);
+  }
+
+  // One per process (GCC only ever calls us from one thread)
+  inline static print_buffer &get() {
+    static print_buffer buffer;
+    return buffer;
+  }
+};
+
+// Trees we've already printed while transforming the current procedure
+// (the same SSA names, constants and types come up over and over)
+inline std::unordered_map<tree, std::string> &gcc_str_memo() {
+  static std::unordered_map<tree, std::string> memo;
+  return memo;
+}
+
+// Call whenever we move on to a new procedure
+inline void gcc_str_reset() { gcc_str_memo().clear(); }
+
+inline std::string gcc_str(gimple *g, bool is_seq = false) {
+  auto &buffer = print_buffer::get();
+  auto mem = buffer.begin();
 
   // Use gimple-pretty-printer's abilities
   if (is_seq) {
@@ -26,43 +74,64 @@ inline std::string gcc_str(gimple *g, bool is_seq = false) {
     print_gimple_stmt(mem, g, 0, TDF_VOPS | TDF_MEMSYMS);
   }
 
-  // Trim the newline it adds
-  buffer[strlen(buffer) - 1] = '\0';
+  return buffer.take();
+}
 
-  // Make it a string
-  auto as_str = std::string(buffer);
+inline const std::string &gcc_str(tree t) {
+  auto &memo = gcc_str_memo();
 
-  // Close in mem file
-  fclose(mem);
+  auto found = memo.find(t);
+  if (found != memo.end()) {
+    return found->second;
+  }
 
-  return as_str;
-}
+  auto &buffer = print_buffer::get();
 
-inline std::string gcc_str(tree t) {
-  // We need some temporary space
-  static const int SIZE = 1024 * 1024;
-  static char buffer[SIZE];
+  // Use tree-pretty-printer's abilities
+  print_generic_stmt(buffer.begin(), t, 0);
 
-  // Clear buffer
-  memset(buffer, 0, SIZE);
+  return memo.emplace(t, buffer.take()).first->second;
+}
 
-  // Get a in-memory file descriptor to put
-  // the string in
-  auto mem = fmemopen(buffer, SIZE, "w");
+// An INTEGER_CST's value in decimal, read straight off the tree. Anything
+// else (no bound at all, or a variable one like a VLA's `D.1234`) is 0
+inline std::string gcc_int_str(tree t) {
+  if (t == NULL_TREE || TREE_CODE(t) != INTEGER_CST) {
+    return "0";
+  }
 
-  // Use tree-pretty-printer's abilities
-  print_generic_stmt(mem, t, 0);
+  char buffer[32];
+  if (tree_fits_shwi_p(t)) {
+    snprintf(buffer, sizeof(buffer), HOST_WIDE_INT_PRINT_DEC, tree_to_shwi(t));
+    return buffer;
+  }
+  if (tree_fits_uhwi_p(t)) {
+    snprintf(buffer, sizeof(buffer), HOST_WIDE_INT_PRINT_UNSIGNED,
+             tree_to_uhwi(t));
+    return buffer;
+  }
 
-  // Trim the newline it adds
-  buffer[strlen(buffer) - 1] = '\0';
+  // Wider than a HOST_WIDE_INT (__int128 and friends)
+  mpz_class value;
+  wi::to_mpz(wi::to_widest(t), value.get_mpz_t(), SIGNED);
+  return value.get_str();
+}
 
-  // Make it a string
-  auto as_str = std::string(buffer);
+// A REAL_CST as an OCaml float literal
+inline std::string gcc_real_str(tree t) {
+  auto value = TREE_REAL_CST(t);
 
-  // Close in mem file
-  fclose(mem);
+  if (REAL_VALUE_ISINF(value)) {
+    return REAL_VALUE_NEGATIVE(value) ? "neg_infinity" : "infinity";
+  }
+  if (REAL_VALUE_ISNAN(value)) {
+    return "nan";
+  }
 
-  return as_str;
+  // Same digits the pretty printer would give us (e.g. 1.5e+0)
+  char buffer[100];
+  real_to_decimal(buffer, &value, sizeof(buffer), 0, 1);
+  return buffer;
 }
 
 inline std::string get_source_lines(const std::string &file_path,
@@ -93,6 +162,37 @@ inline std::string get_source_lines(const std::string &file_path,
   return std::string(buffer, total_size);
 }
 
+inline std::string plugin_arg(types::gcc_plugin_info info,
+                              const std::string &key,
+                              const std::string &fallback = "") {
+  // Later occurrences win, so a flag can be overridden on the command line
+  auto result = fallback;
+  for (auto i = 0; i < info->argc; ++i) {
+    if (key == info->argv[i].key && info->argv[i].value != nullptr) {
+      result = info->argv[i].value;
+    }
+  }
+  return result;
+}
+
+inline uint64_t plugin_arg_u64(types::gcc_plugin_info info,
+                               const std::string &key, uint64_t fallback) {
+  auto value = plugin_arg(info, key);
+  if (value.empty()) {
+    return fallback;
+  }
+
+  char *end = nullptr;
+  auto parsed = strtoull(value.c_str(), &end, 10);
+  if (end == value.c_str() || *end != '\0') {
+    std::cerr << "WARN: Ignoring bad value for -fplugin-arg-" << key << "="
+              << value << std::endl;
+    return fallback;
+  }
+
+  return parsed;
+}
+
 template <typename func> inline void for_each_bb(types::gcc_func fun, func f) {
   types::gcc_bb bb;
 
@@ -30,10 +30,10 @@ inline bool fexists(const std::string& name) {
   return (stat (name.c_str(), &buffer) == 0); 
 }
 
-template<class OutIter>
-inline OutIter write_escaped(std::string const& s, OutIter out) {
+template<class String, class OutIter>
+inline OutIter write_escaped(String const& s, OutIter out) {
   *out++ = '"';
-  for (std::string::const_iterator i = s.begin(), end = s.end(); i != end; ++i) {
+  for (auto i = s.begin(), end = s.end(); i != end; ++i) {
     unsigned char c = *i;
     if (' ' <= c and c <= '~' and c != '\\' and c != '"') {
       *out++ = c;
@@ -83,6 +83,82 @@ inline std::string str_numeric_only(std::string &str) {
   return str;
 }
 
+// 32 hex digits naming something by its contents: MurmurHash3_x64_128
+// (Austin Appleby's, seed 0), h1 then h2. Wide enough that an accidental
+// collision is unlikely, but it isn't cryptographic: anything that can't
+// afford one keeps the full key to compare against
+inline std::string hash128(const std::string &key) {
+  auto data = reinterpret_cast<const uint8_t *>(key.data());
+  auto len = key.size();
+  auto nblocks = len / 16;
+
+  uint64_t h1 = 0, h2 = 0;
+  const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+
+  auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+  auto fmix = [](uint64_t k) {
+    k = (k ^ (k >> 33)) * 0xff51afd7ed558ccdULL;
+    k = (k ^ (k >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    return k ^ (k >> 33);
+  };
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    uint64_t k1, k2;
+    memcpy(&k1, data + i * 16, sizeof(k1));
+    memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+    k1 = rotl(k1 * c1, 31) * c2;
+    h1 ^= k1;
+    h1 = (rotl(h1, 27) + h2) * 5 + 0x52dce729;
+
+    k2 = rotl(k2 * c2, 33) * c1;
+    h2 ^= k2;
+    h2 = (rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+  }
+
+  auto tail = data + nblocks * 16;
+  uint64_t k1 = 0, k2 = 0;
+  switch (len & 15) {
+  case 15: k2 ^= uint64_t(tail[14]) << 48; // fallthrough
+  case 14: k2 ^= uint64_t(tail[13]) << 40; // fallthrough
+  case 13: k2 ^= uint64_t(tail[12]) << 32; // fallthrough
+  case 12: k2 ^= uint64_t(tail[11]) << 24; // fallthrough
+  case 11: k2 ^= uint64_t(tail[10]) << 16; // fallthrough
+  case 10: k2 ^= uint64_t(tail[9]) << 8;   // fallthrough
+  case 9:
+    k2 ^= uint64_t(tail[8]);
+    k2 = rotl(k2 * c2, 33) * c1;
+    h2 ^= k2;
+    // fallthrough
+  case 8: k1 ^= uint64_t(tail[7]) << 56; // fallthrough
+  case 7: k1 ^= uint64_t(tail[6]) << 48; // fallthrough
+  case 6: k1 ^= uint64_t(tail[5]) << 40; // fallthrough
+  case 5: k1 ^= uint64_t(tail[4]) << 32; // fallthrough
+  case 4: k1 ^= uint64_t(tail[3]) << 24; // fallthrough
+  case 3: k1 ^= uint64_t(tail[2]) << 16; // fallthrough
+  case 2: k1 ^= uint64_t(tail[1]) << 8;  // fallthrough
+  case 1:
+    k1 ^= uint64_t(tail[0]);
+    k1 = rotl(k1 * c1, 31) * c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix(h1);
+  h2 = fmix(h2);
+  h1 += h2;
+  h2 += h1;
+
+  char hex[40];
+  snprintf(hex, sizeof(hex), "%016llx%016llx",
+           static_cast<unsigned long long>(h1),
+           static_cast<unsigned long long>(h2));
+  return hex;
+}
+
 inline std::string cwd() {
   char buff[FILENAME_MAX];
 
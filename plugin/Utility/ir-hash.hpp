@@ -0,0 +1,275 @@
+/* Utility/ir-hash.hpp
+ *
+ * Description:
+ *  - A hash of everything the transformer reads off a procedure (its CFG,
+ *    statements, operands, callees' parameter names, and every type those
+ *    reach, field layout and all) that doesn't depend on what the
+ *    procedure is called or on anything GCC numbers per TU (decl UIDs,
+ *    tree addresses): unnamed decls are numbered in the order we meet
+ *    them instead, and a type met again is a back-reference to the first
+ *    time. Two procedures with the same key come out of the transformer as
+ *    the same module, bar their name and those per-TU numbers. The key
+ *    itself is kept (see key()) for whoever needs to tell a collision of
+ *    the hash from a match
+ */
+
+#pragma once
+
+#include "gcc-helpers.hpp"
+#include "general-helpers.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class ir_hasher {
+  std::string buffer;
+
+  // Unnamed decls (temporaries, labels, ...) by first appearance
+  std::unordered_map<tree, size_t> anonymous;
+
+  // Types by first appearance (records can reach themselves)
+  std::unordered_map<tree, size_t> types;
+
+  inline void add(const std::string &s) {
+    buffer += s;
+    buffer += '\x1f';
+  }
+
+  inline void add(uint64_t n) { add(std::to_string(n)); }
+
+  inline void add_name(tree decl) {
+    if (DECL_NAME(decl) != NULL_TREE) {
+      add(gcc_str(DECL_NAME(decl)));
+    } else {
+      auto at = anonymous.emplace(decl, anonymous.size()).first;
+      add("anon" + std::to_string(at->second));
+    }
+  }
+
+  // What the transformer prints next to a decl's name and type
+  inline void add_decl_details(tree decl) {
+    switch (TREE_CODE(decl)) {
+    case FIELD_DECL:
+      add_tree(DECL_SIZE(decl));
+      add(DECL_ALIGN(decl));
+      add_tree(DECL_FIELD_OFFSET(decl));
+      add(DECL_OFFSET_ALIGN(decl));
+      add_tree(DECL_FIELD_BIT_OFFSET(decl));
+      add(DECL_BIT_FIELD(decl) ? 1 : 0);
+      break;
+    case VAR_DECL:
+      add_tree(DECL_SIZE(decl));
+      add(DECL_ALIGN(decl));
+      break;
+    case PARM_DECL:
+      add_type(DECL_ARG_TYPE(decl));
+      break;
+    case CONST_DECL:
+      add_tree(DECL_INITIAL(decl));
+      break;
+    default:
+      break;
+    }
+  }
+
+  inline void add_type(tree t) {
+    if (t == NULL_TREE) {
+      add("-");
+      return;
+    }
+
+    auto seen = types.emplace(t, types.size());
+    if (!seen.second) {
+      add("^" + std::to_string(seen.first->second));
+      return;
+    }
+
+    auto code = TREE_CODE(t);
+    add(code);
+    add(gcc_str(t));
+    add(gcc_int_str(TYPE_SIZE(t)));
+    add(TYPE_UNSIGNED(t) ? 1 : 0);
+
+    switch (code) {
+    case INTEGER_TYPE:
+      add(TYPE_PRECISION(t));
+      add(gcc_int_str(TYPE_MIN_VALUE(t)));
+      add(gcc_int_str(TYPE_MAX_VALUE(t)));
+      break;
+    case REAL_TYPE:
+      add(TYPE_PRECISION(t));
+      break;
+    case OFFSET_TYPE:
+      add_type(TYPE_OFFSET_BASETYPE(t));
+      add_type(TREE_TYPE(t));
+      break;
+    case POINTER_TYPE:
+    case REFERENCE_TYPE:
+    case COMPLEX_TYPE:
+      add_type(TREE_TYPE(t));
+      break;
+    case ARRAY_TYPE:
+      add_type(TREE_TYPE(t));
+      add_type(TYPE_DOMAIN(t));
+      break;
+    case RECORD_TYPE:
+    case UNION_TYPE:
+      add(gcc_str(TYPE_NAME(t)));
+      for (auto member = TYPE_FIELDS(t); member; member = DECL_CHAIN(member)) {
+        add(TREE_CODE(member));
+        add_name(member);
+        add_type(TREE_TYPE(member));
+        add_decl_details(member);
+      }
+      break;
+    case FUNCTION_TYPE:
+      add(TYPE_NAME(t) != NULL_TREE ? gcc_str(TYPE_NAME(t)) : "");
+      add_type(TREE_TYPE(t));
+      for (auto arg = TYPE_ARG_TYPES(t); arg; arg = TREE_CHAIN(arg)) {
+        if (arg == void_list_node) {
+          add("void");
+          break;
+        }
+        add_type(TREE_VALUE(arg));
+      }
+      break;
+    default:
+      // Printed as-is (or as unsupported)
+      break;
+    }
+  }
+
+  inline void add_tree(tree t) {
+    if (t == NULL_TREE) {
+      add("-");
+      return;
+    }
+
+    auto code = TREE_CODE(t);
+    add(code);
+
+    if (TYPE_P(t)) {
+      add_type(t);
+      return;
+    }
+
+    if (code == SSA_NAME) {
+      add(SSA_NAME_VERSION(t));
+      add_tree(SSA_NAME_VAR(t));
+      add_type(TREE_TYPE(t));
+      return;
+    }
+
+    if (DECL_P(t)) {
+      add_name(t);
+      add_type(TREE_TYPE(t));
+      add_decl_details(t);
+      return;
+    }
+
+    if (CONSTANT_CLASS_P(t)) {
+      add(gcc_str(t));
+      add_type(TREE_TYPE(t));
+      return;
+    }
+
+    add_type(TREE_TYPE(t));
+    if (EXPR_P(t)) {
+      for (int i = 0; i < TREE_OPERAND_LENGTH(t); ++i) {
+        add_tree(TREE_OPERAND(t, i));
+      }
+    } else if (code == CASE_LABEL_EXPR) {
+      add_tree(CASE_LOW(t));
+      add_tree(CASE_HIGH(t));
+      add_tree(CASE_LABEL(t));
+    } else if (code == TREE_LIST) {
+      for (; t != NULL_TREE; t = TREE_CHAIN(t)) {
+        add_tree(TREE_PURPOSE(t));
+        add_tree(TREE_VALUE(t));
+      }
+    } else if (code == CONSTRUCTOR) {
+      unsigned i;
+      tree index, value;
+      FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(t), i, index, value) {
+        add_tree(index);
+        add_tree(value);
+      }
+    } else {
+      // Nothing else shows up in lowered statements; its printed form
+      // will do
+      add(gcc_str(t));
+    }
+  }
+
+  inline void add_stmt(gimple *gs) {
+    add(gimple_code(gs));
+
+    // A PHI has no operands as far as gimple_op goes; the transformer
+    // assigns its result from each argument at the end of that edge's
+    // source block
+    if (gimple_code(gs) == GIMPLE_PHI) {
+      auto phi = as_a<gphi *>(gs);
+      add_tree(gimple_phi_result(phi));
+      for (unsigned i = 0; i < gimple_phi_num_args(phi); ++i) {
+        add(gimple_phi_arg_edge(phi, i)->src->index);
+        add_tree(PHI_ARG_DEF(phi, i));
+      }
+      return;
+    }
+
+    add(gimple_expr_code(gs));
+
+    if (is_gimple_call(gs)) {
+      auto call = as_a<gcall *>(gs);
+      if (gimple_call_internal_p(call)) {
+        add(internal_fn_name(gimple_call_internal_fn(call)));
+      }
+      // The call names its arguments after the callee's parameters
+      add_type(gimple_expr_type(gs));
+      if (auto callee = gimple_call_fndecl(call)) {
+        for (auto arg = DECL_ARGUMENTS(callee); arg; arg = DECL_CHAIN(arg)) {
+          add(gcc_str(TREE_VALUE(arg)));
+        }
+      }
+    }
+    if (gimple_code(gs) == GIMPLE_ASM) {
+      add(gimple_asm_string(as_a<gasm *>(gs)));
+    }
+
+    for (unsigned i = 0; i < gimple_num_ops(gs); ++i) {
+      add_tree(gimple_op(gs, i));
+    }
+  }
+
+public:
+  inline std::string hash(types::gcc_func fun) {
+    buffer.clear();
+    anonymous.clear();
+    types.clear();
+
+    for_each_param(fun, [&](tree param, int32_t) { add_tree(param); });
+    auto result = DECL_RESULT(fun->decl);
+    add_type(result != NULL_TREE ? TREE_TYPE(result) : NULL_TREE);
+
+    for_each_bb(fun, [&](types::gcc_bb bb, int32_t index) {
+      add("bb" + std::to_string(index));
+      for_each_bb_succ(bb, [&](types::gcc_edge e) {
+        add(e->dest->index);
+        add(e->flags & (EDGE_TRUE_VALUE | EDGE_FALSE_VALUE | EDGE_FALLTHRU |
+                        EDGE_ABNORMAL | EDGE_EH));
+      });
+      if (bb->index != ENTRY_BLOCK && bb->index != EXIT_BLOCK) {
+        for_each_stmt(bb, [&](gimple *gs) { add_stmt(gs); });
+      }
+    });
+
+    return hash128(buffer);
+  }
+
+  // What the last hash() was taken over
+  inline const std::string &key() const { return buffer; }
+};
+}
+}
+} // c2ocaml::frontend::util
@@ -0,0 +1,107 @@
+/* Utility/tu-module.hpp
+ *
+ * Description:
+ *  - Collects every procedure of a translation unit into one OCaml module
+ *    (-fplugin-arg-c2ocaml-output=tu). Procedures are spooled to a side
+ *    file as they are finished; when the TU is done the module is written
+ *    as preamble + offset table + the TU's shared definitions + procedures
+ *    and renamed into place, so nothing needs merging afterwards
+ */
+
+#pragma once
+
+#include "constants.hpp"
+#include "emitter.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class tu_module {
+  struct entry {
+    std::string name;
+    int32_t fid;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  std::string path, spoolPath;
+  std::ofstream spool;
+  std::vector<entry> entries;
+
+  // Fixed width so the table's size doesn't depend on the offsets in it
+  inline static std::string field(uint64_t value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%010llu ",
+             static_cast<unsigned long long>(value));
+    return buffer;
+  }
+
+  inline std::string table(uint64_t base) const {
+    std::string res = "(* c2ocaml: " + std::to_string(entries.size()) +
+                      " procedures (byte offsets into this file)\n"
+                      "   offset     length     fid        name\n";
+    for (auto &e : entries) {
+      res += "   " + field(base + e.offset) + field(e.length) +
+             field(static_cast<uint64_t>(e.fid)) + e.name + "\n";
+    }
+    return res + "*)\n";
+  }
+
+public:
+  inline bool is_open() const { return spool.is_open(); }
+
+  inline const std::string &module_path() const { return path; }
+
+  inline bool open(const std::string &modulePath) {
+    path = modulePath;
+    spoolPath = path + ".spool." + std::to_string(getpid());
+    spool.open(spoolPath, std::ofstream::out | std::ofstream::trunc |
+                              std::ofstream::binary);
+    return spool.is_open();
+  }
+
+  inline void add(const std::string &name, int32_t fid, ml_emitter &emitter) {
+    auto start = static_cast<uint64_t>(spool.tellp());
+    emitter.write_to(spool);
+    auto end = static_cast<uint64_t>(spool.tellp());
+
+    entries.push_back(entry{name, fid, start, end - start});
+  }
+
+  // shared is whatever the procedures expect to be defined before them
+  inline bool finish(const std::string &shared = "") {
+    if (!spool.is_open()) {
+      return true;
+    }
+    spool.close();
+
+    auto preamble = std::string(constants::ML_PREAMBLE);
+
+    // The table's size only depends on the names, so this is exact
+    auto base = preamble.size() + table(0).size() + shared.size();
+
+    auto tmp = path + ".tmp." + std::to_string(getpid());
+    std::ofstream out(tmp, std::ofstream::out | std::ofstream::trunc |
+                               std::ofstream::binary);
+    std::ifstream in(spoolPath, std::ifstream::in | std::ifstream::binary);
+
+    out << preamble << table(base) << shared;
+    if (in.peek() != std::ifstream::traits_type::eof()) {
+      out << in.rdbuf();
+    }
+    out.close();
+    in.close();
+
+    unlink(spoolPath.c_str());
+
+    if (out.fail() || rename(tmp.c_str(), path.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
@@ -0,0 +1,157 @@
+/* Utility/type-catalog.hpp
+ *
+ * Description:
+ *  - A project-wide catalog of type definitions
+ *    (-fplugin-arg-c2ocaml-type-catalog=<dir>). Every type is named after
+ *    a 128-bit hash of its definition (ty_<hash>) and the definition is
+ *    written to <dir>/<depth>/<hash> by whichever gcc process gets there
+ *    first, so a header type is stored once for the whole project instead
+ *    of once per procedure or TU. Entries are written to a temporary file
+ *    and linked into place, so concurrent processes only ever see whole
+ *    entries; an entry that is already there must hold exactly our
+ *    definition, or we pick the next free name (<hash>_1, ...).
+ *    Depth is 1 + the deepest type a definition refers to, so
+ *    merge-sources can build the TypeCatalog module just by concatenating
+ *    the depth directories in order
+ */
+
+#pragma once
+
+#include "general-helpers.hpp"
+
+namespace c2ocaml {
+namespace frontend {
+namespace util {
+
+class type_catalog {
+  std::string dir;
+
+  // What this process named each definition, and the depth of every
+  // name (anything else, i.e. _typeSELF, is 0)
+  std::unordered_map<std::string, std::string> names;
+  std::unordered_map<std::string, uint32_t> depths;
+
+  // Deepest entry referenced by each definition that is in progress
+  std::vector<uint32_t> frames;
+
+  uint64_t written = 0;
+  uint64_t found = 0;
+  uint64_t collisions = 0;
+
+  // False if the entry is there but holds something else: a hash
+  // collision (or a damaged entry), so the name is taken
+  inline bool store(const std::string &sub, const std::string &file,
+                    const std::string &contents) {
+    auto path = sub + "/" + file;
+    auto tmp = path + ".tmp." + std::to_string(getpid());
+
+    auto write_tmp = [&]() {
+      std::ofstream out(tmp, std::ofstream::out | std::ofstream::trunc |
+                                 std::ofstream::binary);
+      out << contents;
+      return static_cast<bool>(out.flush());
+    };
+    if (!write_tmp()) {
+      std::error_code ec;
+      fs::create_directories(sub, ec);
+      if (!write_tmp()) {
+        unlink(tmp.c_str());
+        return true;
+      }
+    }
+
+    // Linked into place, so exactly one process makes each entry and
+    // everyone else compares theirs with it (renamed where links don't
+    // work at all)
+    auto linked = link(tmp.c_str(), path.c_str());
+    auto error = errno;
+    if (linked != 0 && error != EEXIST) {
+      linked = rename(tmp.c_str(), path.c_str());
+    }
+    unlink(tmp.c_str());
+
+    if (linked == 0) {
+      written += 1;
+      return true;
+    }
+    if (error != EEXIST) {
+      return true;
+    }
+
+    std::ifstream in(path, std::ifstream::in | std::ifstream::binary);
+    std::string existing{std::istreambuf_iterator<char>(in),
+                         std::istreambuf_iterator<char>()};
+    if (existing != contents) {
+      return false;
+    }
+    found += 1;
+    return true;
+  }
+
+public:
+  explicit type_catalog(const std::string &dir) : dir(dir) {}
+
+  // What a module referring to the catalog's names needs up front
+  inline static const char *module_open() { return "open TypeCatalog;;\n"; }
+
+  // Starts a definition (everything it refers to gets use()d before it is
+  // finish()ed)
+  inline void begin() { frames.push_back(0); }
+
+  // Notes that the definition in progress refers to name
+  inline void use(const std::string &name) {
+    if (frames.empty()) {
+      return;
+    }
+    auto at = depths.find(name);
+    if (at != depths.end()) {
+      frames.back() = std::max(frames.back(), at->second);
+    }
+  }
+
+  // Ends the definition begun last; returns its catalog name
+  inline std::string finish(const std::string &body) {
+    auto depth = frames.back() + 1;
+    frames.pop_back();
+
+    auto at = names.find(body);
+    if (at != names.end()) {
+      return at->second;
+    }
+
+    char sub[16];
+    snprintf(sub, sizeof(sub), "/%04u", depth);
+
+    // The same definition always gets the same depth, so it goes into the
+    // hash: different definitions can then only share a name through a
+    // 128-bit collision, and store() catches those within a depth
+    auto file = hash128(std::to_string(depth) + "\n" + body);
+
+    for (uint32_t probe = 0;; ++probe) {
+      auto suffix = probe == 0 ? std::string() : "_" + std::to_string(probe);
+      auto name = "ty_" + file + suffix;
+
+      if (depths.count(name) == 0 &&
+          store(dir + sub, file + suffix,
+                "let " + name + " = \n    " + body + "\n")) {
+        names.emplace(body, name);
+        depths.emplace(name, depth);
+        return name;
+      }
+      collisions += 1;
+    }
+  }
+
+  inline std::string stats() const {
+    auto res = std::to_string(depths.size()) + " types, " +
+               std::to_string(written) + " written, " +
+               std::to_string(found) + " already in the catalog";
+    if (collisions != 0) {
+      res += ", " + std::to_string(collisions) + " hash collisions";
+    }
+    return res;
+  }
+};
+}
+}
+} // c2ocaml::frontend::util
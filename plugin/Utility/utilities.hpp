@@ -11,11 +11,19 @@
 
 #define UNUSED(x) (void)(x)
 
+#include "arena.hpp"
+#include "artifact-store.hpp"
+#include "async-writer.hpp"
 #include "concat.hpp"
 #include "constants.hpp"
+#include "content-index.hpp"
+#include "emitter.hpp"
 #include "gcc-helpers.hpp"
 #include "general-helpers.hpp"
+#include "ir-hash.hpp"
 #include "path-enumeration.hpp"
+#include "tu-module.hpp"
+#include "type-catalog.hpp"
 #include "types.hpp"
 
 // Very heavily used utility func